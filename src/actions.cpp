@@ -27,12 +27,17 @@
 #include "files.hpp"
 #include "markups.hpp"
 #include "state.hpp"
+#include "timings.hpp"
+#include "trace.hpp"
+#include "template_stats.hpp"
 #include "state_save.hpp"
 #include "grammar.hpp"
 #include "input_path.hpp"
 #include "block_tags.hpp"
 #include "phrase_tags.hpp"
 #include "id_manager.hpp"
+#include "include_cache.hpp"
+#include "disk_cache.hpp"
 
 namespace quickbook
 {
@@ -67,7 +72,7 @@ namespace quickbook
                 id_category::categories category =
                     id_category::explicit_anchor_id)
         {
-            std::string placeholder = state.ids.add_anchor(id, category);
+            std::string placeholder = state.ids->add_anchor(id, category);
             state.anchors.push_back(placeholder);
             return placeholder;
         }
@@ -295,7 +300,7 @@ namespace quickbook
         value_consumer values = phrase;
         state.phrase
             << "<footnote id=\""
-            << state.ids.add_id("f", id_category::numbered)
+            << state.ids->add_id("f", id_category::numbered)
             << "\"><para>"
             << values.consume().get_encoded()
             << "</para></footnote>";
@@ -349,7 +354,7 @@ namespace quickbook
             {
                 state.out << "<bridgehead renderas=\"sect" << level << "\"";
                 state.out << " id=\"";
-                state.out << state.ids.add_id("h", id_category::numbered);
+                state.out << state.ids->add_id("h", id_category::numbered);
                 state.out << "\">";
                 state.out << "<phrase id=\"" << id << "\"/>";
                 state.out << "<link linkend=\"" << id << "\">";
@@ -381,7 +386,7 @@ namespace quickbook
 
         if (generic)
         {
-            level = state.ids.section_level() + 1;
+            level = state.ids->section_level() + 1;
                                             // We need to use a heading which is one greater
                                             // than the current.
             if (level > 6 )                 // The max is h6, clip it if it goes
@@ -398,18 +403,18 @@ namespace quickbook
         {
             // Use an explicit id.
 
-            std::string anchor = state.ids.add_id(
+            std::string anchor = state.ids->add_id(
                 element_id.get_quickbook(),
                 id_category::explicit_id);
 
             write_bridgehead(state, level,
                 content.get_encoded(), anchor, self_linked_headers);
         }
-        else if (state.ids.compatibility_version() >= 106u)
+        else if (state.ids->compatibility_version() >= 106u)
         {
             // Generate ids for 1.6+
 
-            std::string anchor = state.ids.add_id(
+            std::string anchor = state.ids->add_id(
                 detail::make_identifier(content.get_quickbook()),
                 id_category::generated_heading);
 
@@ -429,20 +434,26 @@ namespace quickbook
             // Note that this doesn't affect the actual boostbook generated for
             // the content, it's just used to generate this id.
 
-            std::string id = detail::make_identifier(
-                    state.ids.replace_placeholders_with_unresolved_ids(
-                        content.get_encoded()));
+            std::string content_ids =
+                state.ids->replace_placeholders_with_unresolved_ids(
+                    content.get_encoded());
 
-            if (generic || state.ids.compatibility_version() >= 103) {
+            // The unresolved ids depend on the file's parents.
+            if (content_ids != content.get_encoded())
+                dont_cache_include(state);
+
+            std::string id = detail::make_identifier(content_ids);
+
+            if (generic || state.ids->compatibility_version() >= 103) {
                 std::string anchor =
-                    state.ids.add_id(id, id_category::generated_heading);
+                    state.ids->add_id(id, id_category::generated_heading);
 
                 write_bridgehead(state, level,
                     content.get_encoded(), anchor, self_linked_headers);
             }
             else {
                 std::string anchor =
-                    state.ids.old_style_id(id, id_category::generated_heading);
+                    state.ids->old_style_id(id, id_category::generated_heading);
 
                 write_bridgehead(state, level,
                     content.get_encoded(), anchor, false);
@@ -574,8 +585,8 @@ namespace quickbook
 
     std::string state::add_callout(value v)
     {
-        std::string callout_id1 = ids.add_id("c", id_category::numbered);
-        std::string callout_id2 = ids.add_id("c", id_category::numbered);
+        std::string callout_id1 = ids->add_id("c", id_category::numbered);
+        std::string callout_id2 = ids->add_id("c", id_category::numbered);
 
         callouts.insert(encoded_value(callout_id1));
         callouts.insert(encoded_value(callout_id2));
@@ -672,6 +683,9 @@ namespace quickbook
     {
         write_anchors(state, state.phrase);
 
+        if (str == quickbook_get_date || str == quickbook_get_time)
+            dont_cache_include(state);
+
         if (str == quickbook_get_date)
         {
             char strdate[64];
@@ -729,6 +743,8 @@ namespace quickbook
             state.source_mode : detail::to_s(state.source_mode_next.get_quickbook());
         state.source_mode_next = value();
 
+        trace_span span(state.tracer, "code", source_mode);
+
         if (inline_code) {
             write_anchors(state, state.phrase);
         }
@@ -795,8 +811,8 @@ namespace quickbook
     {
         write_anchors(state, state.phrase);
 
-        while (first != last)
-            detail::print_char(*first++, state.phrase.get());
+        detail::print_string(boost::string_ref(first.base(),
+                last.base() - first.base()), state.phrase.get());
     }
 
     void escape_unicode_action::operator()(parse_iterator first, parse_iterator last) const
@@ -948,7 +964,7 @@ namespace quickbook
            //
            fs::path img = detail::generic_to_path(fileref);
            if (!img.has_root_directory())
-              img = quickbook::image_location / img;  // relative path
+              img = state.image_location / img;  // relative path
 
            //
            // Now load the SVG file:
@@ -1047,6 +1063,9 @@ namespace quickbook
             macro_id.begin()
           , macro_id.end()
           , phrase);
+
+        write_cache_string(state.macro_definitions, macro_id);
+        write_cache_string(state.macro_definitions, phrase);
     }
 
     void template_body_action(quickbook::state& state, quickbook::value template_definition)
@@ -1261,6 +1280,10 @@ namespace quickbook
             return;
         }
 
+        trace_span span(state.tracer, "template", symbol->identifier,
+            state.current_file, first);
+        template_call_stats stats(state, symbol);
+
         // The template arguments should have the scope that the template was
         // called from, not the template's own scope.
         //
@@ -1288,7 +1311,7 @@ namespace quickbook
 
             // Store the current section level so that we can ensure that
             // [section] and [endsect] tags in the template are balanced.
-            state.min_section_level = state.ids.section_level();
+            state.min_section_level = state.ids->section_level();
 
             ///////////////////////////////////
             // Prepare the arguments as local templates
@@ -1325,7 +1348,7 @@ namespace quickbook
                 return;
             }
 
-            if (state.ids.section_level() != state.min_section_level)
+            if (state.ids->section_level() != state.min_section_level)
             {
                 detail::outerr(state.current_file, first)
                     << "Mismatched sections in template "
@@ -1567,14 +1590,14 @@ namespace quickbook
         std::string table_id;
 
         if (!element_id.empty()) {
-            table_id = state.ids.add_id(element_id, id_category::explicit_id);
+            table_id = state.ids->add_id(element_id, id_category::explicit_id);
         }
         else if (has_title) {
-            if (state.ids.compatibility_version() >= 105) {
-                table_id = state.ids.add_id(detail::make_identifier(title.get_quickbook()), id_category::generated);
+            if (state.ids->compatibility_version() >= 105) {
+                table_id = state.ids->add_id(detail::make_identifier(title.get_quickbook()), id_category::generated);
             }
             else {
-                table_id = state.ids.add_id("t", id_category::numbered);
+                table_id = state.ids->add_id("t", id_category::numbered);
             }
         }
 
@@ -1657,7 +1680,7 @@ namespace quickbook
         value content = values.consume();
         values.finish();
 
-        std::string full_id = state.ids.begin_section(
+        std::string full_id = state.ids->begin_section(
             !element_id.empty() ?
                 element_id.get_quickbook() :
                 detail::make_identifier(content.get_quickbook()),
@@ -1670,7 +1693,7 @@ namespace quickbook
 
         write_anchors(state, state.out);
 
-        if (self_linked_headers && state.ids.compatibility_version() >= 103)
+        if (self_linked_headers && state.ids->compatibility_version() >= 103)
         {
             state.out << "<link linkend=\"" << full_id << "\">"
                 << content.get_encoded()
@@ -1689,7 +1712,7 @@ namespace quickbook
     {
         write_anchors(state, state.out);
 
-        if (state.ids.section_level() <= state.min_section_level)
+        if (state.ids->section_level() <= state.min_section_level)
         {
             file_position const pos = state.current_file->position_of(first);
 
@@ -1701,7 +1724,7 @@ namespace quickbook
         }
 
         state.out << "</section>";
-        state.ids.end_section();
+        state.ids->end_section();
     }
     
     void element_id_warning_action::operator()(parse_iterator first, parse_iterator) const
@@ -1833,6 +1856,10 @@ namespace quickbook
 
     xinclude_path calculate_xinclude_path(value const& p, quickbook::state& state)
     {
+        // The path depends on the file system, and the parent's xinclude
+        // base.
+        dont_cache_include(state);
+
         path_details details = check_path(p, state);
 
         fs::path path = detail::generic_to_path(details.value);
@@ -1964,8 +1991,20 @@ namespace quickbook
             // update the __FILENAME__ macro
             state.update_filename_macro();
         
-            // parse the file
-            quickbook::parse_file(state, include_doc_id, true);
+            // parse the file, or use the cached output
+            boost::timer::cpu_timer timer;
+            include_cache cache(state, load_type, include_doc_id);
+
+            if (!cache.replay()) {
+                cache.start_recording();
+                quickbook::parse_file(state, include_doc_id, true);
+                cache.finish_recording();
+            }
+
+            if (state.phase_timings) {
+                state.phase_timings->add_file(paths.filename,
+                    timer.elapsed(), state.current_file->source().size());
+            }
 
             // Don't restore source_mode on older versions.
             if (keep_inner_source_mode) save.source_mode = state.source_mode;
@@ -1986,10 +2025,20 @@ namespace quickbook
 
         std::string ext = paths.filename.extension().generic_string();
         std::vector<template_symbol> storage;
+        boost::timer::cpu_timer timer;
+        trace_span span(state.tracer, "snippets",
+            detail::path_to_generic(paths.filename));
         // Throws load_error
         state.error_count +=
             load_snippets(paths.filename, storage, ext, load_type);
 
+        if (state.phase_timings) {
+            boost::system::error_code ec;
+            boost::uintmax_t size = fs::file_size(paths.filename, ec);
+            state.phase_timings->add_file(paths.filename,
+                timer.elapsed(), ec ? 0 : size);
+        }
+
         if (load_type == block_tags::include)
         {
             state.templates.push();
@@ -2042,6 +2091,10 @@ namespace quickbook
         for (; i != e; ++i)
         {
             include_search_return const & paths = *i;
+            trace_span span(state.tracer,
+                include.get_tag() == block_tags::import ? "import" : "include",
+                detail::path_to_generic(paths.filename));
+
             try {
                 if (qbk_version_n >= 106)
                 {
@@ -2074,12 +2127,21 @@ namespace quickbook
             catch (load_error& e) {
                 ++state.error_count;
 
-                detail::outerr(state.current_file, first)
-                    << "Loading file "
-                    << paths.filename
-                    << ": "
-                    << e.what()
-                    << std::endl;
+                // Errors in the loaded file are reported where they are,
+                // others at the include.
+                if (e.line >= 0) {
+                    detail::outerr(paths.filename, e.line)
+                        << e.what()
+                        << std::endl;
+                }
+                else {
+                    detail::outerr(state.current_file, first)
+                        << "Loading file "
+                        << paths.filename
+                        << ": "
+                        << e.what()
+                        << std::endl;
+                }
             }
         }
     }
@@ -19,6 +19,9 @@
 #include "values.hpp"
 #include "files.hpp"
 #include "input_path.hpp"
+#include "disk_cache.hpp"
+#include <boost/lexical_cast.hpp>
+#include <boost/foreach.hpp>
 
 namespace quickbook
 {
@@ -36,6 +39,7 @@ namespace quickbook
             , source_file(source_file)
             , source_type(source_type)
             , error_count(0)
+            , warning_count(0)
         {
             source_file->is_code_snippets = true;
             content.start(source_file);
@@ -95,6 +99,7 @@ namespace quickbook
         file_ptr source_file;
         char const* const source_type;
         int error_count;
+        int warning_count;
     };
 
     struct python_code_snippet_grammar
@@ -338,6 +343,122 @@ namespace quickbook
         actions_type& actions;
     };
 
+    namespace
+    {
+        // Snippets that were loaded without any errors or warnings are
+        // cached with the file, so that they can be reused without parsing
+        // it again. Only the identifiers and bodies are kept, each load
+        // creates new values for them.
+        typedef std::vector<std::pair<std::string, file_ptr> >
+            cached_snippets;
+
+        std::string snippet_cache_key(bool is_python)
+        {
+            return boost::lexical_cast<std::string>(qbk_version_n) +
+                (is_python ? "-python-snippets" : "-cpp-snippets");
+        }
+
+        void cache_snippets(file_ptr const& source_file, bool is_python,
+                std::vector<template_symbol>::const_iterator begin,
+                std::vector<template_symbol>::const_iterator end)
+        {
+            boost::shared_ptr<cached_snippets> snippets(new cached_snippets);
+            boost::uintmax_t size = 0;
+
+            for (; begin != end; ++begin)
+            {
+                file_ptr body = begin->content.get_file();
+                snippets->push_back(std::make_pair(begin->identifier, body));
+                size += begin->identifier.size() + body->source().size();
+            }
+
+            set_file_cache_data(source_file, snippet_cache_key(is_python),
+                snippets, size);
+        }
+
+        // The cached bodies map back to the load of the file they were
+        // created from, so they're remapped to this load, which might
+        // have a different path.
+        void add_snippets(std::vector<template_symbol>& storage,
+                file_ptr const& source_file, cached_snippets const& snippets)
+        {
+            // As in code_snippet_actions, the snippets are marked as code
+            // when they're created from the file.
+            source_file->is_code_snippets = true;
+            std::vector<std::string> params;
+
+            BOOST_FOREACH(cached_snippets::value_type const& x, snippets)
+            {
+                file_ptr body = remap_file(x.second, source_file);
+                storage.push_back(template_symbol(x.first, params,
+                    qbk_value(body, body->source().begin(),
+                        body->source().end(), template_tags::snippet)));
+            }
+        }
+
+        // Snippets in the disk cache are keyed on the file's contents
+        // rather than its name, so that they can be shared by different
+        // copies of the same file.
+        std::string snippet_disk_key(file_ptr const& source_file,
+                bool is_python)
+        {
+            return cache_key("snippets", source_file->source(),
+                boost::lexical_cast<std::string>(qbk_version_n) +
+                (is_python ? "-python" : "-cpp"));
+        }
+
+        void write_disk_snippets(std::string const& key,
+                file_ptr const& source_file,
+                std::vector<template_symbol>::const_iterator begin,
+                std::vector<template_symbol>::const_iterator end)
+        {
+            std::string out;
+            write_cache_int(out, end - begin);
+
+            for (; begin != end; ++begin)
+            {
+                write_cache_string(out, begin->identifier);
+                write_mapped_file(out, begin->content.get_file());
+            }
+
+            write_cache_entry(key, source_file->source(), out);
+        }
+
+        bool read_disk_snippets(std::string const& key,
+                file_ptr const& source_file,
+                std::vector<template_symbol>& snippets)
+        {
+            boost::string_ref in;
+            boost::shared_ptr<void> storage =
+                read_cache_entry(key, source_file->source(), in);
+            if (!storage) return false;
+
+            boost::uint64_t count;
+            if (!read_cache_int(in, count) || count > in.size()) return false;
+
+            // As in code_snippet_actions, the snippets are marked as code
+            // when they're created from the file.
+            source_file->is_code_snippets = true;
+            std::vector<std::string> params;
+
+            for (; count; --count)
+            {
+                boost::string_ref id;
+                if (!read_cache_string(in, id)) return false;
+
+                file_ptr body = read_mapped_file(in, source_file, storage);
+                if (!body) return false;
+
+                snippets.push_back(template_symbol(
+                    std::string(id.begin(), id.end()), params,
+                    qbk_value(body, body->source().begin(),
+                        body->source().end(), template_tags::snippet)));
+            }
+
+            return in.empty();
+        }
+    }
+
     int load_snippets(
         fs::path const& filename
       , std::vector<template_symbol>& storage   // snippets are stored in a
@@ -349,7 +470,38 @@ namespace quickbook
             load_type == block_tags::import);
 
         bool is_python = extension == ".py";
-        code_snippet_actions a(storage, load(filename, qbk_version_n), is_python ? "[python]" : "[c++]");
+        file_ptr source_file = load(filename, qbk_version_n);
+
+        {
+            boost::shared_ptr<cached_snippets const> cached =
+                boost::static_pointer_cast<cached_snippets const>(
+                    get_file_cache_data(source_file,
+                        snippet_cache_key(is_python)));
+
+            if (cached) {
+                add_snippets(storage, source_file, *cached);
+                return 0;
+            }
+        }
+
+        std::string disk_key;
+
+        if (disk_cache_enabled()) {
+            disk_key = snippet_disk_key(source_file, is_python);
+
+            std::vector<template_symbol>::size_type start = storage.size();
+
+            if (read_disk_snippets(disk_key, source_file, storage)) {
+                cache_snippets(source_file, is_python,
+                    storage.begin() + start, storage.end());
+                return 0;
+            }
+
+            storage.erase(storage.begin() + start, storage.end());
+        }
+
+        std::vector<template_symbol>::size_type start = storage.size();
+        code_snippet_actions a(storage, source_file, is_python ? "[python]" : "[c++]");
 
         string_iterator first(a.source_file->source().begin());
         string_iterator last(a.source_file->source().end());
@@ -364,6 +516,16 @@ namespace quickbook
         }
 
         assert(info.full);
+
+        if (!a.error_count && !a.warning_count) {
+            if (!disk_key.empty())
+                write_disk_snippets(disk_key, source_file,
+                    storage.begin() + start, storage.end());
+
+            cache_snippets(source_file, is_python,
+                storage.begin() + start, storage.end());
+        }
+
         return a.error_count;
     }
 
@@ -467,6 +629,7 @@ namespace quickbook
                 detail::outwarn(source_file, first)
                     << "Mismatched end snippet."
                     << std::endl;
+                ++warning_count;
             }
             return;
         }
@@ -494,6 +657,7 @@ namespace quickbook
                     << snippet_stack->id
                     << "'"
                     << std::endl;
+                ++warning_count;
             }
             
             end_snippet_impl(pos);
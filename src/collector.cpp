@@ -53,6 +53,21 @@ namespace quickbook
         top = boost::ref(streams.top());
     }
     
+    void
+    collector::reset(string_stream& out)
+    {
+        streams = std::stack<string_stream>();
+        main = boost::ref(out);
+        top = boost::ref(out);
+    }
+
+    void
+    collector::reset()
+    {
+        default_.clear();
+        reset(default_);
+    }
+
     void 
     collector::pop()
     {
@@ -70,6 +70,11 @@ namespace quickbook
         void push();
         void pop();
 
+        // Discard any pushed streams, and write to 'out', or the
+        // default stream.
+        void reset(string_stream& out);
+        void reset();
+
         std::ostream& get() const
         {
             return top.get().get();
@@ -8,6 +8,7 @@
 
 #include "dependency_tracker.hpp"
 #include "input_path.hpp"
+#include "stat_cache.hpp"
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
@@ -28,7 +29,7 @@ namespace quickbook
 
         // Pop path sections from path until we find an existing
         // path, adjusting for any dot path sections.
-        while (!fs::exists(fs::status(p))) {
+        while (!cached_exists(p)) {
             fs::path name = p.filename();
             p = p.parent_path();
             if (name == "..") {
@@ -54,7 +55,7 @@ namespace quickbook
 
         // Cannoicalize the existing part of the path, and add 'extra' back to
         // the end.
-        return fs::canonical(p) / extra;
+        return cached_canonical(p) / extra;
     }
 
     static char const* control_escapes[16] = {
@@ -101,8 +102,9 @@ namespace quickbook
     }
 
     bool dependency_tracker::add_dependency(fs::path const& f) {
-        bool found = fs::exists(fs::status(f));
+        bool found = cached_exists(f);
         dependencies[normalize_path(f)] |= found;
+        if (recording) recording->push_back(std::make_pair(f, found));
         return found;
     }
 
@@ -10,6 +10,7 @@
 #define QUICKBOOK_DEPENDENCY_TRACKER_HPP
 
 #include <map>
+#include <vector>
 #include <iosfwd>
 #include <boost/filesystem/path.hpp>
 
@@ -18,13 +19,24 @@ namespace quickbook
     namespace fs = boost::filesystem;
 
     struct dependency_tracker {
+        // Each normalized path, and whether it was found.
+        typedef std::map<fs::path, bool> dependency_list;
+
+        // Each path as it was added, and whether it was found.
+        typedef std::vector<std::pair<fs::path, bool> > added_dependencies;
+
     private:
 
-        typedef std::map<fs::path, bool> dependency_list;
         dependency_list dependencies;
 
     public:
 
+        dependency_tracker() : recording(0) {}
+
+        // When set, every call to 'add_dependency' is also appended to
+        // this. Used to record the files that an included file depends on.
+        added_dependencies* recording;
+
         enum flags {
             default_ = 0,
             checked = 1,
@@ -37,6 +49,10 @@ namespace quickbook
 
         void write_dependencies(fs::path const&, flags = default_);
         void write_dependencies(std::ostream&, flags = default_);
+
+        dependency_list const& get_dependencies() const {
+            return dependencies;
+        }
     };
 }
 
@@ -0,0 +1,197 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "disk_cache.hpp"
+#include "version.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace quickbook
+{
+    namespace
+    {
+        fs::path cache_dir;
+
+        // Identifies an entry, and the version of the format. Change this
+        // when the format of any entry changes, so that old entries are
+        // ignored.
+        char const cache_magic[] = "QBKCACHE2\n";
+        std::size_t const cache_magic_size = sizeof(cache_magic) - 1;
+
+        // Each entry also records the version of quickbook that wrote it,
+        // as a different version might parse or generate things
+        // differently, even when the format is the same.
+        boost::string_ref const cache_version(QUICKBOOK_VERSION);
+
+        // 64-bit FNV-1a.
+        boost::uint64_t hash_content(boost::string_ref x)
+        {
+            boost::uint64_t hash = 14695981039346656037ULL;
+
+            for (boost::string_ref::const_iterator it = x.begin();
+                    it != x.end(); ++it)
+            {
+                hash ^= static_cast<unsigned char>(*it);
+                hash *= 1099511628211ULL;
+            }
+
+            return hash;
+        }
+    }
+
+    void set_cache_dir(fs::path const& dir)
+    {
+        cache_dir = dir;
+    }
+
+    bool disk_cache_enabled()
+    {
+        return !cache_dir.empty();
+    }
+
+    std::string cache_key(char const* kind, boost::string_ref content,
+            std::string const& variant)
+    {
+        // The size is included to make collisions less likely.
+        char buffer[64];
+        std::sprintf(buffer, "-%016llx-%llu",
+            static_cast<unsigned long long>(hash_content(content)),
+            static_cast<unsigned long long>(content.size()));
+
+        std::string key(kind);
+        key += buffer;
+        if (!variant.empty()) {
+            key += '-';
+            key += variant;
+        }
+        return key;
+    }
+
+    boost::shared_ptr<void> read_cache_entry(std::string const& key,
+            boost::string_ref content, boost::string_ref& data)
+    {
+        assert(disk_cache_enabled());
+
+        boost::shared_ptr<boost::iostreams::mapped_file_source> mapping;
+
+        try {
+            fs::path filename = cache_dir / key;
+            if (!fs::exists(filename)) return boost::shared_ptr<void>();
+            mapping.reset(new boost::iostreams::mapped_file_source(filename));
+        }
+        catch (std::exception&) {
+            return boost::shared_ptr<void>();
+        }
+
+        if (!mapping->is_open()) return boost::shared_ptr<void>();
+
+        boost::string_ref entry(mapping->data(), mapping->size());
+        boost::string_ref entry_version;
+        boost::string_ref entry_content;
+        boost::uint64_t size;
+
+        if (entry.substr(0, cache_magic_size) != cache_magic)
+            return boost::shared_ptr<void>();
+        entry.remove_prefix(cache_magic_size);
+
+        if (!read_cache_string(entry, entry_version) ||
+                entry_version != cache_version)
+            return boost::shared_ptr<void>();
+
+        // Check that the entry is complete, and is for this content rather
+        // than something with the same hash.
+        if (!read_cache_int(entry, size) || size != entry.size() ||
+                !read_cache_string(entry, entry_content) ||
+                entry_content != content)
+            return boost::shared_ptr<void>();
+
+        data = entry;
+        return mapping;
+    }
+
+    void write_cache_entry(std::string const& key, boost::string_ref content,
+            boost::string_ref data)
+    {
+        assert(disk_cache_enabled());
+
+        std::string content_header;
+        write_cache_string(content_header, content);
+
+        std::string header(cache_magic, cache_magic_size);
+        write_cache_string(header, cache_version);
+        write_cache_int(header, content_header.size() + data.size());
+        header += content_header;
+
+        boost::system::error_code ec;
+        fs::path temp = fs::unique_path(cache_dir / (key + "-%%%%-%%%%.tmp"),
+            ec);
+        if (ec) return;
+
+        {
+            fs::ofstream out(temp, std::ios_base::out | std::ios_base::binary);
+            out.write(header.data(), header.size());
+            out.write(data.data(), data.size());
+            out.close();
+
+            if (!out) {
+                fs::remove(temp, ec);
+                return;
+            }
+        }
+
+        fs::rename(temp, cache_dir / key, ec);
+        if (ec) fs::remove(temp, ec);
+    }
+
+    void write_cache_int(std::string& out, boost::uint64_t x)
+    {
+        while (x >= 0x80) {
+            out += static_cast<char>((x & 0x7f) | 0x80);
+            x >>= 7;
+        }
+
+        out += static_cast<char>(x);
+    }
+
+    void write_cache_string(std::string& out, boost::string_ref x)
+    {
+        write_cache_int(out, x.size());
+        out.append(x.begin(), x.end());
+    }
+
+    bool read_cache_int(boost::string_ref& in, boost::uint64_t& x)
+    {
+        x = 0;
+
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (in.empty()) return false;
+            unsigned char c = static_cast<unsigned char>(in[0]);
+            in.remove_prefix(1);
+
+            x |= static_cast<boost::uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) return true;
+        }
+
+        return false;
+    }
+
+    bool read_cache_string(boost::string_ref& in, boost::string_ref& x)
+    {
+        boost::uint64_t size;
+        if (!read_cache_int(in, size) || size > in.size()) return false;
+
+        x = in.substr(0, size);
+        in.remove_prefix(size);
+        return true;
+    }
+}
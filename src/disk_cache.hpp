@@ -0,0 +1,62 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_DISK_CACHE_HPP)
+#define BOOST_QUICKBOOK_DISK_CACHE_HPP
+
+#include <string>
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <boost/cstdint.hpp>
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // An on disk cache, which can be shared by several processes, of work
+    // done when loading files. Entries are named after a hash of the
+    // content they were created from, so they never go out of date. As
+    // different content can have the same hash, each entry also stores
+    // the content, which is checked when it's read, and the version of
+    // quickbook that wrote it, so that entries from other versions are
+    // ignored. Each one is written to a temporary file and then renamed,
+    // so a reader never sees a partially written entry.
+    //
+    // The cache is disabled until a directory is set.
+    void set_cache_dir(fs::path const&);
+    bool disk_cache_enabled();
+
+    // The name of the entry of type 'kind' for 'content'. 'variant'
+    // distinguishes between entries created from the same content in
+    // different ways, such as for different quickbook language versions.
+    std::string cache_key(char const* kind, boost::string_ref content,
+            std::string const& variant = std::string());
+
+    // Memory maps an entry. If there isn't a valid entry for 'key' that
+    // was created from 'content', returns null. Otherwise 'data' is set to
+    // its contents, which are kept alive by the returned pointer.
+    boost::shared_ptr<void> read_cache_entry(std::string const& key,
+            boost::string_ref content, boost::string_ref& data);
+
+    // Stores an entry. Failure is ignored, as it just means that the
+    // work will be done again next time.
+    void write_cache_entry(std::string const& key, boost::string_ref content,
+            boost::string_ref data);
+
+    // A compact binary encoding for entries. Integers are written with a
+    // variable length encoding, so that the format doesn't depend on the
+    // platform. The read functions remove what they've read from the
+    // front of 'in', and return false if it's malformed.
+    void write_cache_int(std::string& out, boost::uint64_t);
+    void write_cache_string(std::string& out, boost::string_ref);
+    bool read_cache_int(boost::string_ref& in, boost::uint64_t&);
+    bool read_cache_string(boost::string_ref& in, boost::string_ref&);
+}
+
+#endif
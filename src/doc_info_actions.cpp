@@ -21,6 +21,7 @@
 #include "actions.hpp"
 #include "doc_info_tags.hpp"
 #include "id_manager.hpp"
+#include "include_cache.hpp"
 
 namespace quickbook
 {
@@ -245,20 +246,24 @@ namespace quickbook
 
         if (!compatibility_version) {
             compatibility_version = use_doc_info ?
-                qbk_version_n : state.ids.compatibility_version();
+                qbk_version_n : state.ids->compatibility_version();
         }
 
         // Start file, finish here if not generating document info.
 
         if (!use_doc_info)
         {
-            state.ids.start_file(compatibility_version, include_doc_id_, id_,
+            state.ids->start_file(compatibility_version, include_doc_id_, id_,
                     doc_title);
             return "";
         }
 
+        // The document info uses the current time, and starting a document
+        // can't be recorded by the id manager.
+        dont_cache_include(state);
+
         std::string id_placeholder =
-            state.ids.start_file_with_docinfo(
+            state.ids->start_file_with_docinfo(
                 compatibility_version, include_doc_id_, id_, doc_title);
 
         // Make sure we really did have a document info block.
@@ -469,7 +474,7 @@ namespace quickbook
         if (!license.empty())
         {
             tmp << "    <legalnotice id=\""
-                << state.ids.add_id("legal", id_category::generated)
+                << state.ids->add_id("legal", id_category::generated)
                 << "\">\n"
                 << "      <para>\n"
                 << "        " << doc_info_output(license, 103) << "\n"
@@ -550,18 +555,18 @@ namespace quickbook
         // *after* everything else.
 
         // Close any open sections.
-        if (!doc_type.empty() && state.ids.section_level() > 1) {
+        if (!doc_type.empty() && state.ids->section_level() > 1) {
             detail::outwarn(state.current_file->path)
                 << "Missing [endsect] detected at end of file."
                 << std::endl;
 
-            while(state.ids.section_level() > 1) {
+            while(state.ids->section_level() > 1) {
                 state.out << "</section>";
-                state.ids.end_section();
+                state.ids->end_section();
             }
         }
 
-        state.ids.end_file();
+        state.ids->end_file();
         if (!doc_type.empty()) state.out << "\n</" << doc_type << ">\n\n";
     }
 
@@ -8,19 +8,115 @@
     http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 #include "files.hpp"
+#include "disk_cache.hpp"
 #include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/range/algorithm/upper_bound.hpp>
+#include <boost/range/algorithm/lower_bound.hpp>
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/shared_ptr.hpp>
 #include <fstream>
+#include <ctime>
 #include <iterator>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 
 namespace quickbook
 {
     namespace
     {
-        boost::unordered_map<fs::path, file_ptr> files;
+        // A loaded file, along with the modification time and size it had
+        // when loaded, so that it can be reloaded if it changes.
+        struct loaded_file
+        {
+            file_ptr f;
+            std::time_t mtime;
+            boost::uintmax_t size;
+            unsigned generation;
+            std::list<fs::path>::iterator lru_pos;
+
+            // Data created from the file, see 'set_file_cache_data'.
+            std::map<std::string, boost::shared_ptr<void const> > data;
+            boost::uintmax_t data_size;
+        };
+
+        typedef boost::unordered_map<fs::path, loaded_file> file_map;
+
+        // The files that have been loaded. Shared by every document in the
+        // process, so it's guarded by a mutex.
+        file_map files;
+        boost::mutex files_mutex;
+
+        // The loaded files, most recently used first.
+        std::list<fs::path> lru_files;
+        boost::uintmax_t file_cache_size = default_file_cache_size;
+        file_cache_stats cache_stats;
+
+        void clear_file_data(loaded_file& x)
+        {
+            cache_stats.bytes -= x.data_size;
+            x.data.clear();
+            x.data_size = 0;
+        }
+
+        void erase_loaded_file(file_map::iterator pos)
+        {
+            clear_file_data(pos->second);
+            cache_stats.bytes -= pos->second.f->source().size();
+            --cache_stats.files;
+            lru_files.erase(pos->second.lru_pos);
+            files.erase(pos);
+        }
+
+        // Drop the least recently used files that aren't in use, until the
+        // cache is within its size.
+        void evict_loaded_files()
+        {
+            std::list<fs::path>::iterator it = lru_files.end();
+
+            while (cache_stats.bytes > file_cache_size &&
+                    it != lru_files.begin())
+            {
+                file_map::iterator pos = files.find(*--it);
+                assert(pos != files.end());
+
+                // The file's data usually refers to the file, so it's
+                // dropped first. If the file is still in use, this at
+                // least frees the data.
+                clear_file_data(pos->second);
+
+                // Only referenced by the cache.
+                if (pos->second.f->use_count() == 1) {
+                    ++it;
+                    erase_loaded_file(pos);
+                    ++cache_stats.evictions;
+                }
+            }
+        }
+
+        // Incremented by 'check_loaded_files', a cached file is checked
+        // when its generation doesn't match.
+        unsigned files_generation = 0;
+
+        bool use_mapped_files = true;
+
+        bool file_stamp(fs::path const& filename,
+                std::time_t& mtime, boost::uintmax_t& size)
+        {
+            boost::system::error_code ec;
+            mtime = fs::last_write_time(filename, ec);
+            if (ec) return false;
+            size = fs::file_size(filename, ec);
+            return !ec;
+        }
     }
 
     // Read the first few bytes in a file to see it starts with a byte order
@@ -76,63 +172,369 @@ namespace quickbook
     }
 
     // Copy a string, converting mac and windows style newlines to unix
-    // newlines.
+    // newlines. Uses memchr to find carriage returns, as it's usually
+    // vectorized, and copies the runs between them in bulk.
 
-    template <typename InputIterator, typename OutputIterator>
-    void normalize(InputIterator begin, InputIterator end,
-            OutputIterator out)
+    void normalize_newlines(boost::string_ref x, std::string& out)
+    {
+        char const* begin = x.data();
+        char const* end = begin + x.size();
+
+        while (char const* cr = static_cast<char const*>(
+                    std::memchr(begin, '\r', end - begin)))
+        {
+            out.append(begin, cr);
+            out += '\n';
+            begin = cr + 1;
+            if (begin != end && *begin == '\n') ++begin;
+        }
+
+        out.append(begin, end);
+    }
+
+    namespace
+    {
+        boost::uint64_t const high_bits = 0x8080808080808080ULL;
+        boost::uint64_t const low_bits = 0x0101010101010101ULL;
+
+        // Does an ASCII word contain a carriage return?
+        inline bool word_has_cr(boost::uint64_t word)
+        {
+            boost::uint64_t x = word ^ (low_bits * '\r');
+            return ((x - low_bits) & ~x & high_bits) != 0;
+        }
+
+        // The length of the valid sequence at 'pos', or 0 if it's invalid.
+        inline std::size_t utf8_sequence_length(
+                unsigned char const* pos, unsigned char const* end)
+        {
+            unsigned char c = *pos;
+            std::size_t length;
+            unsigned char min = 0x80, max = 0xBF;
+
+            if (c < 0x80) return 1;
+            else if (c < 0xC2) return 0;
+            else if (c < 0xE0) length = 2;
+            else if (c < 0xF0) {
+                length = 3;
+                if (c == 0xE0) min = 0xA0;
+                else if (c == 0xED) max = 0x9F;
+            }
+            else if (c < 0xF5) {
+                length = 4;
+                if (c == 0xF0) min = 0x90;
+                else if (c == 0xF4) max = 0x8F;
+            }
+            else return 0;
+
+            if (static_cast<std::size_t>(end - pos) < length) return 0;
+            if (pos[1] < min || pos[1] > max) return 0;
+
+            for (std::size_t i = 2; i < length; ++i)
+                if ((pos[i] & 0xC0) != 0x80) return 0;
+
+            return length;
+        }
+
+        // Describe the position of an invalid sequence. Everything before
+        // it is valid, so columns are counted in characters.
+        load_error utf8_error(boost::string_ref x, std::size_t pos)
+        {
+            int line = 1;
+            std::size_t line_start = 0;
+
+            for (std::size_t i = 0; i < pos; ++i) {
+                if (x[i] == '\n' || (x[i] == '\r' &&
+                        (i + 1 == x.size() || x[i + 1] != '\n')))
+                {
+                    ++line;
+                    line_start = i + 1;
+                }
+            }
+
+            int column = 1;
+            for (std::size_t i = line_start; i < pos; ++i)
+                if ((x[i] & 0xC0) != 0x80 && x[i] != '\r') ++column;
+
+            std::ostringstream message;
+            message << "Invalid UTF-8 at column " << column << ".";
+            return load_error(message.str(), line);
+        }
+    }
+
+    // Validates UTF-8 a word at a time. Runs of ASCII, which is most of a
+    // typical file, are checked up to 32 bytes at once, and at the same time
+    // searched for carriage returns. Multi-byte sequences are checked one
+    // at a time, rejecting overlong encodings, surrogates and code points
+    // above U+10FFFF.
+
+    std::string::size_type check_utf8(boost::string_ref x, bool& has_cr)
     {
-        std::string encoding = read_bom(begin, end, out);
+        unsigned char const* begin =
+            reinterpret_cast<unsigned char const*>(x.data());
+        unsigned char const* end = begin + x.size();
+        unsigned char const* pos = begin;
+
+        while (pos != end)
+        {
+            while (end - pos >= 32) {
+                boost::uint64_t words[4];
+                std::memcpy(words, pos, 32);
+                if ((words[0] | words[1] | words[2] | words[3]) & high_bits)
+                    break;
+                if (!has_cr) has_cr = word_has_cr(words[0]) ||
+                    word_has_cr(words[1]) || word_has_cr(words[2]) ||
+                    word_has_cr(words[3]);
+                pos += 32;
+            }
+
+            while (end - pos >= 8) {
+                boost::uint64_t word;
+                std::memcpy(&word, pos, 8);
+                if (word & high_bits) break;
+                if (!has_cr) has_cr = word_has_cr(word);
+                pos += 8;
+            }
+
+            if (pos == end) break;
+
+            if (*pos < 0x80) {
+                if (*pos == '\r') has_cr = true;
+                ++pos;
+            }
+            else {
+                std::size_t length = utf8_sequence_length(pos, end);
+                if (!length) return pos - begin;
+                pos += length;
+            }
+        }
+
+        return std::string::npos;
+    }
+
+    void normalize(boost::string_ref x, std::string& out)
+    {
+        boost::string_ref::const_iterator begin = x.begin();
+        std::string encoding = read_bom(begin, x.end(),
+                std::back_inserter(out));
 
         if(encoding != "UTF-8" && encoding != "")
         throw load_error(encoding +
             " is not supported. Please use UTF-8.");
 
-        while(begin != end) {
-            if(*begin == '\r') {
-                *out++ = '\n';
-                ++begin;
-                if(begin != end && *begin == '\n') ++begin;
+        normalize_newlines(boost::string_ref(begin, x.end() - begin), out);
+    }
+
+    // Create a file from its raw contents. If they don't need normalizing,
+    // the file views them directly, keeping 'storage' alive to hold them.
+    // Otherwise they're copied.
+    file* create_file(fs::path const& filename, boost::string_ref data,
+            boost::shared_ptr<void> const& storage)
+    {
+        boost::string_ref::const_iterator begin = data.begin();
+        std::string skipped;
+        std::string encoding = read_bom(begin, data.end(),
+            std::back_inserter(skipped));
+
+        // Other encodings are rejected by 'normalize'.
+        if (encoding == "UTF-8" || encoding == "")
+        {
+            // If there's no BOM, any characters that were skipped are
+            // part of the text.
+            if (encoding == "") begin = data.begin();
+            boost::string_ref text(begin, data.end() - begin);
+
+            bool has_cr = false;
+            std::string::size_type error = check_utf8(text, has_cr);
+            if (error != std::string::npos)
+                throw utf8_error(text, error);
+
+            if (!has_cr) return new file(filename, storage, text, 0);
+        }
+
+        file* f = new file(filename, boost::string_ref(), 0);
+        f->source_.reserve(data.size());
+        normalize(data, f->source_);
+        return f;
+    }
+
+    // Reads a file, memory mapping it when possible.
+    file* read_file(fs::path const& filename)
+    {
+        boost::system::error_code ec;
+        boost::uintmax_t size = fs::file_size(filename, ec);
+
+        // Can't map an empty file.
+        if (use_mapped_files && !ec && size > 0) {
+            boost::shared_ptr<boost::iostreams::mapped_file_source> mapping;
+
+            try {
+                mapping.reset(
+                    new boost::iostreams::mapped_file_source(filename));
             }
-            else {
-                *out++ = *begin++;
+            catch (std::exception&) {
+                // Fall back to reading the file.
+            }
+
+            if (mapping && mapping->is_open()) {
+                return create_file(filename,
+                    boost::string_ref(mapping->data(), mapping->size()),
+                    mapping);
             }
         }
+
+        fs::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+
+        if (!in)
+            throw load_error("Could not open input file.");
+
+        boost::shared_ptr<std::string> data(new std::string());
+        if (!ec) data->reserve(size);
+        data->assign(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+
+        if (in.bad())
+            throw load_error("Error reading input file.");
+
+        return create_file(filename, *data, data);
+    }
+
+    void use_memory_mapped_files(bool x)
+    {
+        use_mapped_files = x;
     }
 
     file_ptr load(fs::path const& filename, unsigned qbk_version)
     {
-        boost::unordered_map<fs::path, file_ptr>::iterator pos
-            = files.find(filename);
+        // Cached by absolute path, as a long running process can load
+        // files from different working directories.
+        fs::path const cache_path = fs::absolute(filename);
+        file_ptr f;
 
-        if (pos == files.end())
         {
-            fs::ifstream in(filename, std::ios_base::in);
+            boost::lock_guard<boost::mutex> lock(files_mutex);
+
+            file_map::iterator pos = files.find(cache_path);
 
-            if (!in)
-                throw load_error("Could not open input file.");
+            if (pos != files.end()) {
+                if (pos->second.generation != files_generation) {
+                    std::time_t mtime;
+                    boost::uintmax_t size;
 
-            // Turn off white space skipping on the stream
-            in.unsetf(std::ios::skipws);
+                    if (file_stamp(filename, mtime, size) &&
+                            mtime == pos->second.mtime &&
+                            size == pos->second.size) {
+                        pos->second.generation = files_generation;
+                    }
+                    else {
+                        erase_loaded_file(pos);
+                        pos = files.end();
+                    }
+                }
 
-            std::string source;
-            normalize(
-                std::istream_iterator<char>(in),
-                std::istream_iterator<char>(),
-                std::back_inserter(source));
+                if (pos != files.end()) {
+                    f = pos->second.f;
+                    lru_files.splice(lru_files.begin(), lru_files,
+                        pos->second.lru_pos);
+                    ++cache_stats.hits;
+                }
+            }
+        }
 
-            if (in.bad())
-                throw load_error("Error reading input file.");
+        if (!f)
+        {
+            // Stamp before reading, so that a change while reading will
+            // be picked up next time.
+            loaded_file entry;
+            entry.data_size = 0;
+            if (!file_stamp(filename, entry.mtime, entry.size)) {
+                entry.mtime = 0;
+                entry.size = 0;
+            }
 
-            bool inserted;
+            entry.f = read_file(filename);
+
+            // If another thread loaded the file at the same time, this
+            // will use its copy.
+            boost::lock_guard<boost::mutex> lock(files_mutex);
+            entry.generation = files_generation;
+            std::pair<file_map::iterator, bool> inserted =
+                files.emplace(cache_path, entry);
+            f = inserted.first->second.f;
+            ++cache_stats.misses;
+
+            if (inserted.second) {
+                lru_files.push_front(cache_path);
+                inserted.first->second.lru_pos = lru_files.begin();
+                cache_stats.bytes += f->source().size();
+                ++cache_stats.files;
+                evict_loaded_files();
+            }
+        }
 
-            boost::tie(pos, inserted) = files.emplace(
-                filename, new file(filename, source, qbk_version));
+        // The cached file is never modified, instead each load gets a new
+        // instance sharing its source, as the version depends on the
+        // document that loads it.
+        return new file(filename, f, qbk_version);
+    }
 
-            assert(inserted);
+    namespace
+    {
+        // Finds the cache entry for a file returned by 'load'. Returns
+        // null if it's been evicted or reloaded since.
+        loaded_file* find_loaded_file(file_ptr const& f)
+        {
+            file_map::iterator pos = files.find(fs::absolute(f->path));
+
+            return pos != files.end() &&
+                pos->second.f->source().begin() == f->source().begin() ?
+                &pos->second : 0;
         }
+    }
+
+    boost::shared_ptr<void const> get_file_cache_data(file_ptr const& f,
+            std::string const& key)
+    {
+        boost::lock_guard<boost::mutex> lock(files_mutex);
+        loaded_file* entry = find_loaded_file(f);
+        if (!entry) return boost::shared_ptr<void const>();
+
+        std::map<std::string, boost::shared_ptr<void const> >::const_iterator
+            pos = entry->data.find(key);
+        return pos != entry->data.end() ? pos->second :
+            boost::shared_ptr<void const>();
+    }
+
+    void set_file_cache_data(file_ptr const& f, std::string const& key,
+            boost::shared_ptr<void const> const& data, boost::uintmax_t size)
+    {
+        boost::lock_guard<boost::mutex> lock(files_mutex);
+        loaded_file* entry = find_loaded_file(f);
+        if (!entry || entry->data.count(key)) return;
+
+        entry->data[key] = data;
+        entry->data_size += size;
+        cache_stats.bytes += size;
+        evict_loaded_files();
+    }
 
-        return pos->second;
+    void set_file_cache_size(boost::uintmax_t size)
+    {
+        boost::lock_guard<boost::mutex> lock(files_mutex);
+        file_cache_size = size;
+        evict_loaded_files();
+    }
+
+    file_cache_stats get_file_cache_stats()
+    {
+        boost::lock_guard<boost::mutex> lock(files_mutex);
+        return cache_stats;
+    }
+
+    void check_loaded_files()
+    {
+        boost::lock_guard<boost::mutex> lock(files_mutex);
+        ++files_generation;
     }
 
     std::ostream& operator<<(std::ostream& out, file_position const& x)
@@ -140,46 +542,50 @@ namespace quickbook
         return out << "line: " << x.line << ", column: " << x.column;
     }
 
-    file_position relative_position(
-        boost::string_ref::const_iterator begin,
-        boost::string_ref::const_iterator iterator)
+    std::vector<std::size_t> const& file::line_starts() const
     {
-        file_position pos;
-        boost::string_ref::const_iterator line_begin = begin;
+        if (shared_source_) return shared_source_->line_starts();
 
-        while (begin != iterator)
+        // It isn't changed after it's built.
+        boost::lock_guard<boost::mutex> lock(line_starts_mutex_);
+
+        if (line_starts_.empty())
         {
-            if (*begin == '\r')
-            {
-                ++begin;
-                ++pos.line;
-                line_begin = begin;
-            }
-            else if (*begin == '\n')
+            boost::string_ref src = source();
+            std::vector<std::size_t> starts;
+            starts.push_back(0);
+
+            for (std::size_t i = 0; i != src.size(); ++i)
             {
-                ++begin;
-                ++pos.line;
-                line_begin = begin;
-                if (begin == iterator) break;
-                if (*begin == '\r')
+                if (src[i] == '\r')
                 {
-                    ++begin;
-                    line_begin = begin;
+                    if (i + 1 != src.size() && src[i + 1] == '\n') ++i;
+                    starts.push_back(i + 1);
+                }
+                else if (src[i] == '\n')
+                {
+                    starts.push_back(i + 1);
                 }
             }
-            else
-            {
-                ++begin;
-            }
+
+            line_starts_.swap(starts);
         }
 
-        pos.column = iterator - line_begin + 1;
-        return pos;
+        return line_starts_;
     }
 
     file_position file::position_of(boost::string_ref::const_iterator iterator) const
     {
-        return relative_position(source().begin(), iterator);
+        std::vector<std::size_t> const& starts = line_starts();
+        std::size_t offset = iterator - source().begin();
+
+        // The first line start after the position, so the line number
+        // counting from 1.
+        std::size_t line =
+            std::upper_bound(starts.begin(), starts.end(), offset) -
+            starts.begin();
+
+        return file_position(line, offset - starts[line - 1] + 1);
     }
 
     // Mapped files.
@@ -246,15 +652,148 @@ namespace quickbook
         }
     };
     
+    // While a mapped file is being built, its text is kept as a list of
+    // segments, which are either spans of the original file, or text owned
+    // by the mapped file. They're only joined up when it's released, so
+    // that copying part of one mapped file into another doesn't copy the
+    // text, and a file which is a single span doesn't need to be copied
+    // at all.
+    struct mapped_file_segment
+    {
+        std::string::size_type our_pos;
+        boost::string_ref text;
+        // Null for text from the original file.
+        boost::shared_ptr<std::string const> owner;
+
+        mapped_file_segment(std::string::size_type our_pos,
+                boost::string_ref text,
+                boost::shared_ptr<std::string const> const& owner) :
+            our_pos(our_pos), text(text), owner(owner) {}
+    };
+
+    // Text smaller than this is copied into the mapped file's buffer, as
+    // a segment of its own would take up more memory.
+    std::string::size_type const min_segment_size = 256;
+
+    struct mapped_segment_pos_cmp
+    {
+        bool operator()(mapped_file_segment const& x,
+                std::string::size_type const& y)
+        {
+            return x.our_pos < y;
+        }
+
+        bool operator()(std::string::size_type const& x,
+                mapped_file_segment const& y)
+        {
+            return x < y.our_pos;
+        }
+    };
+
     struct mapped_file : file
     {
         mapped_file(file_ptr original) :
             file(*original, std::string()),
-            original(original), mapped_sections()
+            original(original), mapped_sections(),
+            segments(), size(0), owner(), buffer()
         {}
 
         file_ptr original;
         std::vector<mapped_file_section> mapped_sections;
+        std::vector<mapped_file_segment> segments;
+        std::string::size_type size;
+        // If the released file views a single segment, another file, or
+        // an entry in the disk cache, keeps it alive.
+        boost::shared_ptr<void const> owner;
+        // Small pieces of text are added to this, which is never
+        // reallocated, so that they can be viewed.
+        boost::shared_ptr<std::string> buffer;
+
+        // Add part of the original, or of text owned by 'owner'.
+        void append_view(boost::string_ref x,
+                boost::shared_ptr<std::string const> const& owner =
+                    boost::shared_ptr<std::string const>())
+        {
+            if (x.empty()) return;
+
+            if (!segments.empty() && segments.back().owner == owner &&
+                    segments.back().text.end() == x.begin())
+            {
+                boost::string_ref& last = segments.back().text;
+                last = boost::string_ref(last.data(), last.size() + x.size());
+            }
+            else
+            {
+                segments.push_back(mapped_file_segment(size, x, owner));
+            }
+
+            size += x.size();
+        }
+
+        void append_owned(boost::shared_ptr<std::string const> const& x) {
+            append_view(*x, x);
+        }
+
+        void append_owned(boost::string_ref x) {
+            if (!buffer || buffer->capacity() - buffer->size() < x.size()) {
+                // Start small, as most files only have a few pieces.
+                std::string::size_type capacity = buffer ?
+                    (std::min)(buffer->capacity() * 2,
+                        std::string::size_type(65536)) : 64;
+                buffer.reset(new std::string());
+                buffer->reserve((std::max)(x.size(), capacity));
+            }
+
+            char const* begin = buffer->data() + buffer->size();
+            buffer->append(x.begin(), x.end());
+            append_view(boost::string_ref(begin, x.size()), buffer);
+        }
+
+        // The text from 'pos' to the end of its segment.
+        boost::string_ref text_from(std::string::size_type pos) const
+        {
+            if (segments.empty()) return source().substr(pos);
+
+            std::vector<mapped_file_segment>::const_iterator segment =
+                boost::upper_bound(segments, pos, mapped_segment_pos_cmp());
+            assert(segment != segments.begin());
+            --segment;
+
+            return segment->text.substr(pos - segment->our_pos);
+        }
+
+        // Called when the file is released, to make the text contiguous.
+        void join_segments()
+        {
+            if (segments.size() == 1) {
+                source_view_ = segments.front().text;
+                owner = segments.front().owner;
+            }
+            else {
+                source_.reserve(size);
+                BOOST_FOREACH(mapped_file_segment const& x, segments)
+                    source_.append(x.text.begin(), x.text.end());
+            }
+
+            std::vector<mapped_file_segment>().swap(segments);
+            buffer.reset();
+        }
+
+        // Used instead of building the file, when it's a copy of another
+        // file, or recreated from the disk cache.
+        void view_source(boost::string_ref text,
+                boost::shared_ptr<void const> const& storage)
+        {
+            size = text.size();
+            source_view_ = text;
+            owner = storage;
+        }
+
+        // The lines in indented sections, so that they can be found with
+        // a binary search. Each one maps the start of a line to the start
+        // of the same line in the original, the text after indentation is
+        // a straight copy.
+        std::vector<mapped_file_section> indented_lines;
         
         void add_empty_mapped_file_section(boost::string_ref::const_iterator pos) {
             std::string::size_type original_pos =
@@ -266,23 +805,30 @@ namespace quickbook
                     mapped_sections.back().original_pos != original_pos)
             {
                 mapped_sections.push_back(mapped_file_section(
-                        original_pos, source().size(),
+                        original_pos, size,
                         mapped_file_section::empty));
             }
         }
 
         void add_mapped_file_section(boost::string_ref::const_iterator pos) {
             mapped_sections.push_back(mapped_file_section(
-                pos - original->source().begin(), source().size()));
+                pos - original->source().begin(), size));
         }
 
         void add_indented_mapped_file_section(boost::string_ref::const_iterator pos)
         {
             mapped_sections.push_back(mapped_file_section(
-                pos - original->source().begin(), source().size(),
+                pos - original->source().begin(), size,
                 mapped_file_section::indented));
         }
 
+        void add_indented_line(boost::string_ref::const_iterator pos,
+                std::string::size_type our_pos)
+        {
+            indented_lines.push_back(mapped_file_section(
+                pos - original->source().begin(), our_pos));
+        }
+
         std::string::size_type to_original_pos(
             std::vector<mapped_file_section>::const_iterator section,
             std::string::size_type pos) const
@@ -295,46 +841,30 @@ namespace quickbook
                     return section->original_pos;
 
                 case mapped_file_section::indented: {
-                    // Will contain the start of the current line.
-                    boost::string_ref::size_type our_line = section->our_pos;
-
-                    // Will contain the number of lines in the block before
-                    // the current line.
-                    unsigned newline_count = 0;
-
-                    for(boost::string_ref::size_type i = section->our_pos;
-                        i != pos; ++i)
-                    {
-                        if (source()[i] == '\n') {
-                            our_line = i + 1;
-                            ++newline_count;
-                        }
-                    }
-
-                    // The start of the line in the original source.
-                    boost::string_ref::size_type original_line =
-                        section->original_pos;
-                    
-                    while(newline_count > 0) {
-                        if (original->source()[original_line] == '\n')
-                            --newline_count;
-                        ++original_line;
-                    }
+                    // The last line which starts before the position.
+                    std::vector<mapped_file_section>::const_iterator line =
+                        boost::upper_bound(indented_lines, pos,
+                            mapped_section_pos_cmp());
+                    assert(line != indented_lines.begin());
+                    --line;
+                    assert(line->our_pos >= section->our_pos);
 
                     // The start of line content (i.e. after indentation).
-                    our_line = skip_indentation(source(), our_line);
+                    boost::string_ref::size_type our_line = line->our_pos +
+                        skip_indentation(text_from(line->our_pos), 0);
 
                     // The position is in the middle of indentation, so
                     // just return the start of the whitespace, which should
                     // be good enough.
-                    if (our_line > pos) return original_line;
+                    if (our_line > pos) return line->original_pos;
 
-                    original_line =
-                        skip_indentation(original->source(), original_line);
+                    boost::string_ref::size_type original_line =
+                        skip_indentation(original->source(), line->original_pos);
 
                     // Confirm that we are actually in the same position.
-                    assert(original->source()[original_line] ==
-                        source()[our_line]);
+                    assert(text_from(our_line).empty() ||
+                        original->source()[original_line] ==
+                            text_from(our_line)[0]);
 
                     // Calculate the position
                     return original_line + (pos - our_line);
@@ -346,11 +876,10 @@ namespace quickbook
         }
         
         std::vector<mapped_file_section>::const_iterator find_section(
-            boost::string_ref::const_iterator pos) const
+            std::string::size_type pos) const
         {
             std::vector<mapped_file_section>::const_iterator section =
-                boost::upper_bound(mapped_sections,
-                    std::string::size_type(pos - source().begin()),
+                boost::upper_bound(mapped_sections, pos,
                     mapped_section_pos_cmp());
             assert(section != mapped_sections.begin());
             --section;
@@ -371,10 +900,6 @@ namespace quickbook
 
     };
 
-    namespace {
-        std::list<mapped_file> mapped_files;
-    }
-
     struct mapped_file_builder_data
     {
         mapped_file_builder_data() { reset(); }
@@ -398,6 +923,7 @@ namespace quickbook
 
     file_ptr mapped_file_builder::release()
     {
+        data->new_file->join_segments();
         file_ptr r = data->new_file;
         data->reset();
         return r;
@@ -410,49 +936,67 @@ namespace quickbook
     
     bool mapped_file_builder::empty() const
     {
-        return data->new_file->source().empty();
+        return data->new_file->size == 0;
     }
 
     mapped_file_builder::pos mapped_file_builder::get_pos() const
     {
-        return data->new_file->source().size();
+        return data->new_file->size;
     }
     
     void mapped_file_builder::add_at_pos(boost::string_ref x, iterator pos)
     {
         data->new_file->add_empty_mapped_file_section(pos);
-        data->new_file->source_.append(x.begin(), x.end());
+        data->new_file->append_owned(x);
     }
 
     void mapped_file_builder::add(boost::string_ref x)
     {
         data->new_file->add_mapped_file_section(x.begin());
-        data->new_file->source_.append(x.begin(), x.end());
+        if (x.size() < min_segment_size)
+            data->new_file->append_owned(x);
+        else
+            data->new_file->append_view(x);
     }
 
     void mapped_file_builder::add(mapped_file_builder const& x)
     {
-        add(x, 0, x.data->new_file->source_.size());
+        add(x, 0, x.data->new_file->size);
     }
 
     void mapped_file_builder::add(mapped_file_builder const& x,
             pos begin, pos end)
     {
         assert(data->new_file->original == x.data->new_file->original);
-        assert(begin <= x.data->new_file->source_.size());
-        assert(end <= x.data->new_file->source_.size());
+        assert(begin <= x.data->new_file->size);
+        assert(end <= x.data->new_file->size);
 
         if (begin != end)
         {
             std::vector<mapped_file_section>::const_iterator start =
-                x.data->new_file->find_section(
-                    x.data->new_file->source().begin() + begin);
+                x.data->new_file->find_section(begin);
     
-            std::string::size_type size = data->new_file->source_.size();
+            std::string::size_type size = data->new_file->size;
+            std::string::size_type original_begin =
+                x.data->new_file->to_original_pos(start, begin);
     
             data->new_file->mapped_sections.push_back(mapped_file_section(
-                    x.data->new_file->to_original_pos(start, begin),
-                    size, start->section_type));
+                    original_begin, size, start->section_type));
+
+            if (start->section_type == mapped_file_section::indented) {
+                data->new_file->indented_lines.push_back(
+                    mapped_file_section(original_begin, size));
+            }
+
+            for (std::vector<mapped_file_section>::const_iterator
+                    line = boost::upper_bound(x.data->new_file->indented_lines,
+                        begin, mapped_section_pos_cmp());
+                    line != x.data->new_file->indented_lines.end() &&
+                        line->our_pos < end; ++line)
+            {
+                data->new_file->indented_lines.push_back(mapped_file_section(
+                    line->original_pos, line->our_pos - begin + size));
+            }
     
             for (++start; start != x.data->new_file->mapped_sections.end() &&
                     start->our_pos < end; ++start)
@@ -461,10 +1005,24 @@ namespace quickbook
                     start->original_pos, start->our_pos - begin + size,
                     start->section_type));
             }
-    
-            data->new_file->source_.append(
-                x.data->new_file->source_.begin() + begin,
-            x.data->new_file->source_.begin() + end);
+
+            // Share the text instead of copying it.
+            for (std::vector<mapped_file_segment>::const_iterator
+                    segment = boost::upper_bound(x.data->new_file->segments,
+                        begin, mapped_segment_pos_cmp()) - 1;
+                    segment != x.data->new_file->segments.end() &&
+                        segment->our_pos < end; ++segment)
+            {
+                std::string::size_type segment_begin =
+                    (std::max)(begin, segment->our_pos) - segment->our_pos;
+                std::string::size_type segment_end =
+                    (std::min)(end, segment->our_pos + segment->text.size()) -
+                    segment->our_pos;
+
+                data->new_file->append_view(segment->text.substr(
+                    segment_begin, segment_end - segment_begin),
+                    segment->owner);
+            }
         }
     }
 
@@ -554,6 +1112,7 @@ namespace quickbook
         // Trim white spaces from column 0..indent
         std::string unindented_program;
         std::string::size_type copy_start = start;
+        std::string::size_type our_start = data->new_file->size;
         pos = start;
 
         do {
@@ -563,6 +1122,11 @@ namespace quickbook
             unindented_program.append(program.begin() + copy_start, program.begin() + pos);
             copy_start = pos;
 
+            // Blank lines are copied unchanged, so only need to record the
+            // lines that are unindented.
+            data->new_file->add_indented_line(x.begin() + pos,
+                our_start + unindented_program.size());
+
             // Find the end of the indentation.
             std::string::size_type next = program.find_first_not_of(" \t", pos);
             if (next == std::string::npos) next = program.size();
@@ -590,13 +1154,170 @@ namespace quickbook
 
         unindented_program.append(program.begin() + copy_start, program.end());
 
-        data->new_file->add_indented_mapped_file_section(x.begin());
-        data->new_file->source_.append(unindented_program);
+        data->new_file->add_indented_mapped_file_section(x.begin() + start);
+        if (unindented_program.size() < min_segment_size) {
+            data->new_file->append_owned(unindented_program);
+        }
+        else {
+            boost::shared_ptr<std::string> text(new std::string());
+            text->swap(unindented_program);
+            data->new_file->append_owned(text);
+        }
     }
 
     file_position mapped_file::position_of(boost::string_ref::const_iterator pos) const
     {
+        std::string::size_type our_pos = pos - source().begin();
         return original->position_of(original->source().begin() +
-            to_original_pos(find_section(pos), pos - source().begin()));
+            to_original_pos(find_section(our_pos), our_pos));
+    }
+
+    file_ptr remap_file(file_ptr const& f, file_ptr const& original)
+    {
+        mapped_file const& x = dynamic_cast<mapped_file const&>(*f);
+        assert(x.original->source().begin() == original->source().begin());
+
+        boost::intrusive_ptr<mapped_file> y(new mapped_file(original));
+        y->mapped_sections = x.mapped_sections;
+        y->indented_lines = x.indented_lines;
+        y->view_source(x.source(),
+            boost::shared_ptr<file_ptr const>(new file_ptr(f)));
+        return y;
+    }
+
+    void write_mapped_file(std::string& out, file_ptr const& f)
+    {
+        mapped_file const& x = dynamic_cast<mapped_file const&>(*f);
+
+        write_cache_string(out, x.source());
+
+        write_cache_int(out, x.mapped_sections.size());
+        BOOST_FOREACH(mapped_file_section const& section, x.mapped_sections)
+        {
+            write_cache_int(out, section.original_pos);
+            write_cache_int(out, section.our_pos);
+            write_cache_int(out, section.section_type);
+        }
+
+        write_cache_int(out, x.indented_lines.size());
+        BOOST_FOREACH(mapped_file_section const& line, x.indented_lines)
+        {
+            write_cache_int(out, line.original_pos);
+            write_cache_int(out, line.our_pos);
+        }
+    }
+
+    namespace
+    {
+        // Check that the sections read from the cache are in the order
+        // that a mapped_file_builder creates them, so that looking up a
+        // position can rely on it. Sections and lines have to be sorted,
+        // an indented section has to start with one of the indented lines,
+        // and a normal section has to fit in the original.
+        bool valid_mapped_sections(mapped_file const& x,
+                std::string::size_type size,
+                std::string::size_type original_size)
+        {
+            for (std::vector<mapped_file_section>::size_type i = 0;
+                    i < x.indented_lines.size(); ++i)
+            {
+                if (i && x.indented_lines[i].our_pos <
+                        x.indented_lines[i - 1].our_pos)
+                    return false;
+            }
+
+            for (std::vector<mapped_file_section>::size_type i = 0;
+                    i < x.mapped_sections.size(); ++i)
+            {
+                mapped_file_section const& section = x.mapped_sections[i];
+                std::string::size_type end =
+                    i + 1 < x.mapped_sections.size() ?
+                    x.mapped_sections[i + 1].our_pos : size;
+
+                if (end < section.our_pos) return false;
+
+                switch (section.section_type) {
+                    case mapped_file_section::normal:
+                        if (end - section.our_pos >
+                                original_size - section.original_pos)
+                            return false;
+                        break;
+
+                    case mapped_file_section::indented: {
+                        std::vector<mapped_file_section>::const_iterator
+                            line = boost::lower_bound(x.indented_lines,
+                                section.our_pos, mapped_section_pos_cmp());
+                        if (line == x.indented_lines.end() ||
+                                line->our_pos != section.our_pos)
+                            return false;
+                        break;
+                    }
+
+                    default:
+                        break;
+                }
+            }
+
+            return true;
+        }
+    }
+
+    file_ptr read_mapped_file(boost::string_ref& in, file_ptr const& original,
+            boost::shared_ptr<void> const& storage)
+    {
+        boost::intrusive_ptr<mapped_file> x(new mapped_file(original));
+        std::string::size_type original_size = original->source().size();
+        boost::string_ref text;
+        boost::uint64_t count, original_pos, our_pos, section_type;
+
+        if (!read_cache_string(in, text)) return file_ptr();
+
+        if (!read_cache_int(in, count) || count > in.size())
+            return file_ptr();
+        x->mapped_sections.reserve(count);
+
+        for (; count; --count)
+        {
+            if (!read_cache_int(in, original_pos) ||
+                    !read_cache_int(in, our_pos) ||
+                    !read_cache_int(in, section_type) ||
+                    original_pos > original_size ||
+                    our_pos > text.size() ||
+                    section_type > mapped_file_section::indented)
+                return file_ptr();
+
+            x->mapped_sections.push_back(mapped_file_section(
+                original_pos, our_pos,
+                static_cast<mapped_file_section::section_types>(
+                    section_type)));
+        }
+
+        if (!read_cache_int(in, count) || count > in.size())
+            return file_ptr();
+        x->indented_lines.reserve(count);
+
+        for (; count; --count)
+        {
+            if (!read_cache_int(in, original_pos) ||
+                    !read_cache_int(in, our_pos) ||
+                    original_pos > original_size ||
+                    our_pos > text.size())
+                return file_ptr();
+
+            x->indented_lines.push_back(
+                mapped_file_section(original_pos, our_pos));
+        }
+
+        // Positions are looked up with a binary search, so the
+        // first section has to start at the beginning.
+        if (!text.empty() && (x->mapped_sections.empty() ||
+                x->mapped_sections.front().our_pos != 0))
+            return file_ptr();
+
+        if (!valid_mapped_sections(*x, text.size(), original_size))
+            return file_ptr();
+
+        x->view_source(text, storage);
+        return x;
     }
 }
@@ -12,9 +12,14 @@
 #define BOOST_QUICKBOOK_FILES_HPP
 
 #include <string>
+#include <vector>
 #include <boost/filesystem/path.hpp>
 #include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/utility/string_ref.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
 #include <stdexcept>
 #include <cassert>
 #include <iosfwd>
@@ -54,9 +59,31 @@ namespace quickbook {
         bool is_code_snippets;
     private:
         unsigned qbk_version;
-        unsigned ref_count;
+        // Atomic since loaded files are shared by documents compiled
+        // in parallel.
+        boost::detail::atomic_count ref_count;
+        // If set, this file shares the source of another file.
+        boost::intrusive_ptr<file> shared_source_;
+        // Keeps the source alive for files that view a memory mapping.
+        boost::shared_ptr<void> storage_;
+    protected:
+        // If set, the source is a view of memory owned elsewhere, by
+        // 'storage_' or, for mapped files, the original file.
+        boost::string_ref source_view_;
+    private:
+        // The offset of the start of each line, built the first time a
+        // position is looked up. Files can be shared between threads, so
+        // it's built under the file's own lock.
+        mutable std::vector<std::size_t> line_starts_;
+        mutable boost::mutex line_starts_mutex_;
+
+        std::vector<std::size_t> const& line_starts() const;
     public:
-        boost::string_ref source() const { return source_; }
+        boost::string_ref source() const {
+            return shared_source_ ? shared_source_->source() :
+                source_view_.data() ? source_view_ :
+                boost::string_ref(source_);
+        }
 
         file(fs::path const& path, boost::string_ref source,
                 unsigned qbk_version) :
@@ -70,6 +97,22 @@ namespace quickbook {
             qbk_version(f.qbk_version), ref_count(0)
         {}
 
+        // A file which views 'source', kept alive by 'storage'.
+        file(fs::path const& path, boost::shared_ptr<void> const& storage,
+                boost::string_ref source, unsigned qbk_version) :
+            path(path), source_(), is_code_snippets(false),
+            qbk_version(qbk_version), ref_count(0),
+            storage_(storage), source_view_(source)
+        {}
+
+        // Another instance of a loaded file, sharing its source, so that
+        // each load can have its own version and the path it was loaded as.
+        file(fs::path const& path, boost::intrusive_ptr<file> const& f,
+                unsigned qbk_version) :
+            path(path), source_(), is_code_snippets(f->is_code_snippets),
+            qbk_version(qbk_version), ref_count(0), shared_source_(f)
+        {}
+
         virtual ~file() {
             assert(!ref_count);
         }
@@ -89,6 +132,10 @@ namespace quickbook {
 
         virtual file_position position_of(boost::string_ref::const_iterator) const;
 
+        // The number of references to the file, so that the file cache can
+        // tell if it's in use.
+        long use_count() const { return ref_count; }
+
         friend void intrusive_ptr_add_ref(file* ptr) { ++ptr->ref_count; }
 
         friend void intrusive_ptr_release(file* ptr)
@@ -99,10 +146,64 @@ namespace quickbook {
     file_ptr load(fs::path const& filename,
         unsigned qbk_version = 0);
 
+    // For long running processes: the next time each loaded file is
+    // requested, check that it hasn't changed on disk since it was read.
+    void check_loaded_files();
+
+    // Files are memory mapped by default. Long running processes should
+    // turn this off, as a mapped file changes if it's edited in place, and
+    // truncating it can crash the process.
+    void use_memory_mapped_files(bool);
+
+    // Loaded files are cached until they take up more than this many
+    // bytes, then the least recently used files which aren't in use
+    // are dropped.
+    boost::uintmax_t const default_file_cache_size = 256 * 1024 * 1024;
+    void set_file_cache_size(boost::uintmax_t);
+
+    // Data created from a loaded file, such as the code snippets found in
+    // it, can be cached along with it. It's counted in the cache's size,
+    // and dropped when the file is reloaded or evicted. 'f' must have been
+    // returned by 'load', and the data is shared between threads, so it
+    // mustn't be modified. Getting it returns null if there's nothing
+    // cached for 'key'.
+    boost::shared_ptr<void const> get_file_cache_data(file_ptr const& f,
+            std::string const& key);
+    void set_file_cache_data(file_ptr const& f, std::string const& key,
+            boost::shared_ptr<void const> const& data, boost::uintmax_t size);
+
+    struct file_cache_stats
+    {
+        file_cache_stats() :
+            hits(0), misses(0), evictions(0), files(0), bytes(0) {}
+
+        boost::uintmax_t hits;
+        boost::uintmax_t misses;
+        boost::uintmax_t evictions;
+        boost::uintmax_t files;     // Currently cached.
+        boost::uintmax_t bytes;     // Size of the cached sources
+                                    // and their data.
+    };
+
+    file_cache_stats get_file_cache_stats();
+
+    // Returns the offset of the first invalid UTF-8 sequence in 'x', or
+    // npos if it's valid. Sets 'has_cr' if it finds a carriage return,
+    // so that checking if a file needs normalizing doesn't need another
+    // pass.
+    std::string::size_type check_utf8(boost::string_ref x, bool& has_cr);
+
+    // Appends 'x' to 'out', converting CR and CRLF newlines to LF.
+    void normalize_newlines(boost::string_ref x, std::string& out);
+
     struct load_error : std::runtime_error
     {
-        explicit load_error(std::string const& arg)
-            : std::runtime_error(arg) {}
+        explicit load_error(std::string const& arg, int line = -1)
+            : std::runtime_error(arg), line(line) {}
+
+        // The line of the file that the error was found on, or -1 if it
+        // isn't at a particular position.
+        int line;
     };
 
     // Interface for creating fake files which are mapped to
@@ -136,6 +237,20 @@ namespace quickbook {
         mapped_file_builder(mapped_file_builder const&);
         mapped_file_builder& operator=(mapped_file_builder const&);
     };
+
+    // A copy of a file created by a mapped_file_builder, which maps back
+    // to 'original' rather than the file it was built from, so that
+    // positions are reported against its path. 'original' must share the
+    // same source, such as another load of the same file.
+    file_ptr remap_file(file_ptr const& f, file_ptr const& original);
+
+    // Write a file created by a mapped_file_builder to the disk cache's
+    // format, and recreate it from 'original' and the written data. The
+    // recreated file views the data rather than copying it, 'storage' keeps
+    // it alive. Returns null if the data is malformed.
+    void write_mapped_file(std::string& out, file_ptr const&);
+    file_ptr read_mapped_file(boost::string_ref& in, file_ptr const& original,
+            boost::shared_ptr<void> const& storage);
 }
 
 #endif // BOOST_QUICKBOOK_FILES_HPP
@@ -24,6 +24,10 @@ namespace quickbook
     struct section_info;
     struct file;
     struct template_symbol;
+    struct timings;
+    struct trace;
+    struct template_stats;
+    struct include_recording;
     typedef boost::intrusive_ptr<file> file_ptr;
 
     typedef boost::string_ref::const_iterator string_iterator;
@@ -35,5 +35,33 @@ namespace quickbook
         init_block_elements();
         init_phrase_elements();
         init_doc_info();
+
+#if defined(QUICKBOOK_PROFILE_RULES)
+        profiler.add(block_start, "block_start");
+        profiler.add(phrase_start, "phrase_start");
+        profiler.add(nested_phrase, "nested_phrase");
+        profiler.add(inline_phrase, "inline_phrase");
+        profiler.add(paragraph_phrase, "paragraph_phrase");
+        profiler.add(extended_phrase, "extended_phrase");
+        profiler.add(table_title_phrase, "table_title_phrase");
+        profiler.add(inside_preformatted, "inside_preformatted");
+        profiler.add(inside_paragraph, "inside_paragraph");
+        profiler.add(command_line, "command_line");
+        profiler.add(attribute_value_1_7, "attribute_value_1_7");
+        profiler.add(escape, "escape");
+        profiler.add(raw_escape, "raw_escape");
+        profiler.add(skip_entity, "skip_entity");
+        profiler.add(hard_space, "hard_space");
+#if defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
+        profiler.add(space, "space");
+        profiler.add(blank, "blank");
+        profiler.add(eol, "eol");
+        profiler.add(phrase_end, "phrase_end");
+        profiler.add(comment, "comment");
+        profiler.add(line_comment, "line_comment");
+#endif
+        profiler.add(macro_identifier, "macro_identifier");
+        profiler.add(doc_info_details, "doc_info_details");
+#endif
     }
 }
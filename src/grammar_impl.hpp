@@ -14,6 +14,8 @@
 #include "grammar.hpp"
 #include "cleanup.hpp"
 #include "values.hpp"
+#include "parsers.hpp"
+#include "rule_profile.hpp"
 #include <boost/spirit/include/classic_symbols.hpp>
 
 namespace quickbook
@@ -87,12 +89,25 @@ namespace quickbook
 
         // Miscellaneous stuff
         cl::rule<scanner> hard_space;
+#if defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
         cl::rule<scanner> space;
         cl::rule<scanner> blank;
         cl::rule<scanner> eol;
         cl::rule<scanner> phrase_end;
         cl::rule<scanner> comment;
         cl::rule<scanner> line_comment;
+#else
+        // These are tried at almost every character, so they're concrete
+        // parsers rather than rules, which avoids a virtual call for each
+        // attempt. Define QUICKBOOK_DYNAMIC_LEXICAL_RULES to use the
+        // equivalent rules instead, e.g. for debugging.
+        space_parser space;
+        blank_parser blank;
+        eol_parser eol;
+        phrase_end_parser phrase_end;
+        comment_parser<false> comment;
+        comment_parser<true> line_comment;
+#endif
         cl::rule<scanner> macro_identifier;
 
         // Element Symbols       
@@ -100,6 +115,10 @@ namespace quickbook
         
         // Doc Info
         cl::rule<scanner> doc_info_details;
+
+#if defined(QUICKBOOK_PROFILE_RULES)
+        rule_profiler profiler;
+#endif
         
         impl(quickbook::state&);
 
@@ -13,6 +13,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
 #include <boost/range/algorithm.hpp>
+#include <ostream>
 
 // TODO: This should possibly try to always generate valid XML ids:
 // http://www.w3.org/TR/REC-xml/#NT-NameStartChar
@@ -280,20 +281,26 @@ namespace quickbook {
     // replace_ids
     //
     // Return a copy of the xml with all the placeholders replaced by
-    // generated_ids.
+    // generated_ids, or write it to a stream a chunk at a time.
     //
 
     struct replace_ids_callback : xml_processor::callback
     {
+        // Size at which the result is written to the stream.
+        static std::string::size_type const chunk_size = 65536;
+
         id_state const& state;
         std::vector<std::string> const* ids;
+        std::ostream* stream;
         boost::string_ref::const_iterator source_pos;
         std::string result;
 
         replace_ids_callback(id_state const& state,
-                std::vector<std::string> const* ids)
+                std::vector<std::string> const* ids,
+                std::ostream* stream = 0)
           : state(state),
             ids(ids),
+            stream(stream),
             source_pos(),
             result()
         {}
@@ -313,6 +320,8 @@ namespace quickbook {
                 result.append(source_pos, value.begin());
                 result.append(id.begin(), id.end());
                 source_pos = value.end();
+
+                if (stream && result.size() >= chunk_size) write();
             }
         }
 
@@ -320,6 +329,14 @@ namespace quickbook {
         {
             result.append(source_pos, xml.end());
             source_pos = xml.end();
+
+            if (stream) write();
+        }
+
+        void write()
+        {
+            stream->write(result.data(), result.size());
+            result.clear();
         }
     };
 
@@ -332,6 +349,14 @@ namespace quickbook {
         return callback.result;
     }
 
+    void replace_ids(id_state const& state, boost::string_ref xml,
+            std::ostream& out, std::vector<std::string> const* ids)
+    {
+        xml_processor processor;
+        replace_ids_callback callback(state, ids, &out);
+        processor.parse(xml, callback);
+    }
+
     //
     // normalize_id
     //
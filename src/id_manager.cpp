@@ -8,6 +8,8 @@
 
 #include "id_manager_impl.hpp"
 #include "utils.hpp"
+#include "timings.hpp"
+#include "files.hpp"
 #include <boost/make_shared.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/range/algorithm.hpp>
@@ -91,8 +93,25 @@ namespace quickbook
     // id_manager
     //
 
+    namespace
+    {
+        void record_change(id_changes* changes, id_change::change_type type,
+                boost::string_ref id = boost::string_ref(),
+                id_category category = id_category(),
+                std::string const& placeholder = std::string())
+        {
+            if (!changes) return;
+
+            id_change change(type);
+            change.id = detail::to_s(id);
+            change.category = category;
+            change.placeholder = placeholder;
+            changes->push_back(change);
+        }
+    }
+
     id_manager::id_manager()
-      : state(new id_state)
+      : state(new id_state), recording(0)
     {
     }
 
@@ -104,6 +123,17 @@ namespace quickbook
             boost::string_ref id,
             value const& title)
     {
+        if (recording) {
+            id_change change(id_change::start_file);
+            change.compatibility_version = compatibility_version;
+            change.include_doc_id = detail::to_s(include_doc_id);
+            change.id = detail::to_s(id);
+            change.has_title = title.check();
+            if (change.has_title)
+                change.title = detail::to_s(title.get_quickbook());
+            recording->push_back(change);
+        }
+
         state->start_file(compatibility_version, false, include_doc_id, id, title);
     }
 
@@ -119,17 +149,23 @@ namespace quickbook
 
     void id_manager::end_file()
     {
+        record_change(recording, id_change::end_file);
         state->end_file();
     }
 
     std::string id_manager::begin_section(boost::string_ref id,
             id_category category)
     {
-        return state->begin_section(id, category)->to_string();
+        std::string placeholder =
+            state->begin_section(id, category)->to_string();
+        record_change(recording, id_change::begin_section, id, category,
+            placeholder);
+        return placeholder;
     }
 
     void id_manager::end_section()
     {
+        record_change(recording, id_change::end_section);
         return state->end_section();
     }
 
@@ -140,17 +176,27 @@ namespace quickbook
 
     std::string id_manager::old_style_id(boost::string_ref id, id_category category)
     {
-        return state->old_style_id(id, category)->to_string();
+        std::string placeholder = state->old_style_id(id, category)->to_string();
+        record_change(recording, id_change::old_style_id, id, category,
+            placeholder);
+        return placeholder;
     }
 
     std::string id_manager::add_id(boost::string_ref id, id_category category)
     {
-        return state->add_id(id, category)->to_string();
+        std::string placeholder = state->add_id(id, category)->to_string();
+        record_change(recording, id_change::add_id, id, category,
+            placeholder);
+        return placeholder;
     }
 
     std::string id_manager::add_anchor(boost::string_ref id, id_category category)
     {
-        return state->add_placeholder(id, category)->to_string();
+        std::string placeholder =
+            state->add_placeholder(id, category)->to_string();
+        record_change(recording, id_change::add_anchor, id, category,
+            placeholder);
+        return placeholder;
     }
 
     std::string id_manager::replace_placeholders_with_unresolved_ids(
@@ -159,11 +205,36 @@ namespace quickbook
         return replace_ids(*state, xml);
     }
 
-    std::string id_manager::replace_placeholders(boost::string_ref xml) const
+    std::string id_manager::replace_placeholders(boost::string_ref xml,
+            timings* t) const
+    {
+        assert(!state->current_file);
+        std::vector<std::string> ids;
+
+        {
+            timed_phase phase(t, "generate_ids", xml.size());
+            ids = generate_ids(*state, xml);
+        }
+
+        timed_phase phase(t, "replace_ids", xml.size());
+        std::string result = replace_ids(*state, xml, &ids);
+        phase.set_bytes_out(result.size());
+        return result;
+    }
+
+    void id_manager::replace_placeholders(boost::string_ref xml,
+            std::ostream& out, timings* t) const
     {
         assert(!state->current_file);
-        std::vector<std::string> ids = generate_ids(*state, xml);
-        return replace_ids(*state, xml, &ids);
+        std::vector<std::string> ids;
+
+        {
+            timed_phase phase(t, "generate_ids", xml.size());
+            ids = generate_ids(*state, xml);
+        }
+
+        timed_phase phase(t, "replace_ids", xml.size());
+        replace_ids(*state, xml, out, &ids);
     }
 
     unsigned id_manager::compatibility_version() const
@@ -171,6 +242,51 @@ namespace quickbook
         return state->current_file->compatibility_version;
     }
 
+    void id_manager::record(id_changes* changes)
+    {
+        recording = changes;
+    }
+
+    std::string id_manager::replay(id_change const& change)
+    {
+        switch (change.type)
+        {
+        case id_change::start_file: {
+            // Only the title's quickbook source is used for files which
+            // aren't the root of a document.
+            value title;
+
+            if (change.has_title) {
+                file_ptr title_file = new file(fs::path(), change.title,
+                    change.compatibility_version);
+                title = qbk_value(title_file, title_file->source().begin(),
+                    title_file->source().end());
+            }
+
+            start_file(change.compatibility_version, change.include_doc_id,
+                change.id, title);
+            return std::string();
+        }
+        case id_change::end_file:
+            end_file();
+            return std::string();
+        case id_change::begin_section:
+            return begin_section(change.id, change.category);
+        case id_change::end_section:
+            end_section();
+            return std::string();
+        case id_change::old_style_id:
+            return old_style_id(change.id, change.category);
+        case id_change::add_id:
+            return add_id(change.id, change.category);
+        case id_change::add_anchor:
+            return add_anchor(change.id, change.category);
+        }
+
+        assert(false);
+        return std::string();
+    }
+
     //
     // id_placeholder
     //
@@ -12,6 +12,8 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <string>
+#include <vector>
+#include <iosfwd>
 #include "values.hpp"
 
 namespace quickbook
@@ -44,6 +46,36 @@ namespace quickbook
         categories c;
     };
 
+    //
+    // id_change
+    //
+    // A change made by an included file, recorded so that it can be made
+    // again without parsing the file. Used by the include cache.
+    //
+
+    struct id_change
+    {
+        enum change_type {
+            start_file, end_file, begin_section, end_section,
+            old_style_id, add_id, add_anchor
+        };
+
+        explicit id_change(change_type type)
+          : type(type), compatibility_version(0), category(),
+            has_title(false) {}
+
+        change_type type;
+        unsigned compatibility_version; // start_file
+        std::string include_doc_id;     // start_file
+        std::string id;
+        id_category category;
+        bool has_title;                 // start_file
+        std::string title;              // start_file
+        std::string placeholder;        // The placeholder that was returned.
+    };
+
+    typedef std::vector<id_change> id_changes;
+
     struct id_state;
 
     struct id_manager
@@ -75,11 +107,22 @@ namespace quickbook
 
         std::string replace_placeholders_with_unresolved_ids(
                 boost::string_ref) const;
-        std::string replace_placeholders(boost::string_ref) const;
+        std::string replace_placeholders(boost::string_ref,
+                timings* = 0) const;
+        void replace_placeholders(boost::string_ref, std::ostream&,
+                timings* = 0) const;
         
         unsigned compatibility_version() const;
+
+        // Append every change to 'changes', until this is called with
+        // null. Starting a file with a docinfo block can't be recorded.
+        void record(id_changes*);
+
+        // Make a recorded change, returning the new placeholder.
+        std::string replay(id_change const&);
     private:
         boost::scoped_ptr<id_state> state;
+        id_changes* recording;
     };
 }
 
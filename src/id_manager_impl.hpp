@@ -110,6 +110,8 @@ namespace quickbook
 
     std::string replace_ids(id_state const& state, boost::string_ref xml,
             std::vector<std::string> const* = 0);
+    void replace_ids(id_state const& state, boost::string_ref xml,
+            std::ostream&, std::vector<std::string> const* = 0);
     std::vector<std::string> generate_ids(id_state const&, boost::string_ref);
 
     std::string normalize_id(boost::string_ref src_id);
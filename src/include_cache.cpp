@@ -0,0 +1,420 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "include_cache.hpp"
+#include "state.hpp"
+#include "files.hpp"
+#include "input_path.hpp"
+#include "utils.hpp"
+#include "disk_cache.hpp"
+#include "stat_cache.hpp"
+#include "id_manager_impl.hpp"
+#include "block_tags.hpp"
+#include "quickbook.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/foreach.hpp>
+#include <cassert>
+#include <iterator>
+#include <map>
+#include <set>
+
+namespace quickbook
+{
+    namespace
+    {
+        // Reads a file that an included file depended on, to check that
+        // it's unchanged.
+        bool read_dependency(fs::path const& path, std::string& content)
+        {
+            fs::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+            if (!in) return false;
+
+            content.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+            return !in.bad();
+        }
+
+        // Replaces the placeholders in intermediate xml. If a placeholder
+        // isn't in the map, it was created outside of the included file,
+        // and 'complete' is set to false.
+        struct replace_cached_placeholders : xml_processor::callback
+        {
+            typedef std::map<std::string, std::string> placeholder_map;
+
+            explicit replace_cached_placeholders(
+                    placeholder_map const& placeholders)
+              : placeholders(placeholders),
+                source_pos(),
+                result(),
+                complete(true)
+            {}
+
+            void start(boost::string_ref xml)
+            {
+                source_pos = xml.begin();
+            }
+
+            void id_value(boost::string_ref value)
+            {
+                // The same check as 'id_state::get_placeholder'.
+                if (value.size() <= 1 || *value.begin() != '$') return;
+
+                placeholder_map::const_iterator it =
+                    placeholders.find(detail::to_s(value));
+
+                if (it == placeholders.end()) {
+                    complete = false;
+                    return;
+                }
+
+                result.append(source_pos, value.begin());
+                result.append(it->second);
+                source_pos = value.end();
+            }
+
+            void finish(boost::string_ref xml)
+            {
+                result.append(source_pos, xml.end());
+                source_pos = xml.end();
+            }
+
+            placeholder_map const& placeholders;
+            boost::string_ref::const_iterator source_pos;
+            std::string result;
+            bool complete;
+        };
+
+        void write_id_change(std::string& out, id_change const& change)
+        {
+            write_cache_int(out, change.type);
+            write_cache_int(out, change.compatibility_version);
+            write_cache_string(out, change.include_doc_id);
+            write_cache_string(out, change.id);
+            write_cache_int(out, change.category.c);
+            write_cache_int(out, change.has_title);
+            write_cache_string(out, change.title);
+            write_cache_string(out, change.placeholder);
+        }
+
+        bool read_id_change(boost::string_ref& in, id_changes& changes)
+        {
+            boost::uint64_t type, version, category, has_title;
+            boost::string_ref include_doc_id, id, title, placeholder;
+
+            if (!read_cache_int(in, type) ||
+                    type > id_change::add_anchor ||
+                    !read_cache_int(in, version) ||
+                    !read_cache_string(in, include_doc_id) ||
+                    !read_cache_string(in, id) ||
+                    !read_cache_int(in, category) ||
+                    category > id_category::explicit_anchor_id ||
+                    !read_cache_int(in, has_title) ||
+                    !read_cache_string(in, title) ||
+                    !read_cache_string(in, placeholder))
+                return false;
+
+            id_change change(static_cast<id_change::change_type>(type));
+            change.compatibility_version = static_cast<unsigned>(version);
+            change.include_doc_id = detail::to_s(include_doc_id);
+            change.id = detail::to_s(id);
+            change.category = id_category(static_cast<int>(category));
+            change.has_title = has_title != 0;
+            change.title = detail::to_s(title);
+            change.placeholder = detail::to_s(placeholder);
+            changes.push_back(change);
+            return true;
+        }
+    }
+
+    include_cache::include_cache(quickbook::state& state,
+            value::tag_type load_type, value const& include_doc_id)
+      : state(state),
+        key_material(),
+        key(),
+        recording(),
+        is_recording(false),
+        out_size(0),
+        phrase_size(0),
+        error_count(0),
+        message_count(0)
+    {
+        // Imported files, and files included by older versions of
+        // quickbook, add their templates to the including file's scope,
+        // which can't be repeated. Nothing is parsed after an error. And
+        // the rest is output that the file might change.
+        if (!disk_cache_enabled() ||
+                load_type != block_tags::include ||
+                qbk_version_n < 106u ||
+                state.error_count ||
+                state.template_statistics ||
+                !state.anchors.empty() ||
+                state.callout_depth ||
+                state.in_list ||
+                state.explicit_list ||
+                state.source_mode_next.check())
+            return;
+
+        std::string material;
+
+        if (!state.templates.describe(material)) return;
+        write_cache_string(material, state.macro_definitions);
+        write_cache_string(material, state.current_file->source());
+
+        // Relative paths are resolved from the current directory.
+        boost::system::error_code ec;
+        fs::path current_directory = fs::current_path(ec);
+        if (ec) return;
+        write_cache_string(material,
+            detail::path_to_generic(current_directory));
+
+        write_cache_string(material,
+            detail::path_to_generic(state.current_file->path));
+        write_cache_string(material,
+            detail::path_to_generic(state.filename_relative));
+        write_cache_string(material,
+            detail::path_to_generic(state.xinclude_base));
+        write_cache_string(material,
+            detail::path_to_generic(state.image_location));
+        write_cache_int(material, include_path.size());
+        BOOST_FOREACH(fs::path const& path, include_path) {
+            write_cache_string(material, detail::path_to_generic(path));
+        }
+        write_cache_int(material, self_linked_headers);
+        write_cache_int(material, debug_mode);
+        write_cache_int(material, qbk_version_n);
+        write_cache_int(material, state.ids->compatibility_version());
+        write_cache_int(material, state.ids->section_level());
+        write_cache_int(material, state.min_section_level);
+        write_cache_int(material, state.template_depth);
+        write_cache_string(material, state.source_mode);
+        write_cache_int(material, !include_doc_id.empty());
+        if (!include_doc_id.empty())
+            write_cache_string(material, include_doc_id.get_quickbook());
+
+        key = cache_key("include", material);
+        key_material.swap(material);
+    }
+
+    include_cache::~include_cache()
+    {
+        // Only happens when parsing the file threw an exception.
+        if (is_recording) {
+            recording.cacheable = false;
+            stop_recording();
+        }
+    }
+
+    bool include_cache::replay()
+    {
+        if (key_material.empty()) return false;
+
+        boost::string_ref in;
+        boost::shared_ptr<void> storage =
+            read_cache_entry(key, key_material, in);
+        if (!storage) return false;
+
+        boost::string_ref output;
+        boost::uint64_t count;
+
+        if (!read_cache_string(in, output) ||
+                !read_cache_int(in, count) || count > in.size())
+            return false;
+
+        id_changes changes;
+        changes.reserve(count);
+
+        for (boost::uint64_t i = 0; i < count; ++i) {
+            if (!read_id_change(in, changes)) return false;
+        }
+
+        // Check that the files the included file depended on haven't
+        // changed, before making any changes.
+        if (!read_cache_int(in, count) || count > in.size()) return false;
+
+        dependency_tracker::added_dependencies dependencies;
+        dependencies.reserve(count);
+        std::string current;
+
+        for (boost::uint64_t i = 0; i < count; ++i) {
+            boost::string_ref path, content;
+            boost::uint64_t found;
+
+            if (!read_cache_string(in, path) ||
+                    !read_cache_int(in, found) ||
+                    (found && !read_cache_string(in, content)))
+                return false;
+
+            fs::path p = detail::generic_to_path(path);
+            if (cached_exists(p) != (found != 0)) return false;
+            if (found && (!read_dependency(p, current) || current != content))
+                return false;
+
+            dependencies.push_back(std::make_pair(p, found != 0));
+        }
+
+        if (!in.empty()) return false;
+
+        BOOST_FOREACH(dependency_tracker::added_dependencies::value_type const&
+                dependency, dependencies)
+        {
+            state.dependencies.add_dependency(dependency.first);
+        }
+
+        // Make the same changes to the ids, which will create new
+        // placeholders, so replace the old ones in the output.
+        replace_cached_placeholders::placeholder_map placeholders;
+
+        BOOST_FOREACH(id_change const& change, changes)
+        {
+            std::string placeholder = state.ids->replay(change);
+            if (!change.placeholder.empty())
+                placeholders[change.placeholder] = placeholder;
+        }
+
+        replace_cached_placeholders replace(placeholders);
+        xml_processor().parse(output, replace);
+        assert(replace.complete);
+
+        state.out << replace.result;
+        return true;
+    }
+
+    void include_cache::start_recording()
+    {
+        if (key_material.empty()) return;
+
+        recording.parent = state.recording;
+        state.recording = &recording;
+        state.ids->record(&recording.ids);
+        state.dependencies.recording = &recording.dependencies;
+        is_recording = true;
+
+        out_size = state.out.str().size();
+        phrase_size = state.phrase.str().size();
+        error_count = state.error_count;
+        message_count = detail::message_count();
+    }
+
+    void include_cache::finish_recording()
+    {
+        if (!is_recording) return;
+
+        if (recording.cacheable && check_recording())
+        {
+            boost::string_ref output(state.out.str());
+            output = output.substr(out_size);
+
+            // Check that the output only uses placeholders that the file
+            // created, as the others won't be the same next time.
+            replace_cached_placeholders::placeholder_map placeholders;
+
+            BOOST_FOREACH(id_change const& change, recording.ids)
+            {
+                if (!change.placeholder.empty())
+                    placeholders[change.placeholder] = change.placeholder;
+            }
+
+            replace_cached_placeholders check(placeholders);
+            xml_processor().parse(output, check);
+
+            if (check.complete)
+            {
+                std::string data;
+                write_cache_string(data, output);
+
+                write_cache_int(data, recording.ids.size());
+                BOOST_FOREACH(id_change const& change, recording.ids)
+                {
+                    write_id_change(data, change);
+                }
+
+                // Files are often checked several times, only store them
+                // once.
+                std::set<dependency_tracker::added_dependencies::value_type>
+                    seen;
+                std::string dependencies;
+                std::string content;
+                unsigned dependency_count = 0;
+
+                BOOST_FOREACH(
+                        dependency_tracker::added_dependencies::value_type const&
+                        dependency, recording.dependencies)
+                {
+                    if (!seen.insert(dependency).second) continue;
+
+                    write_cache_string(dependencies,
+                        detail::path_to_generic(dependency.first));
+                    write_cache_int(dependencies, dependency.second);
+
+                    if (dependency.second) {
+                        if (!read_dependency(dependency.first, content)) {
+                            recording.cacheable = false;
+                            break;
+                        }
+
+                        write_cache_string(dependencies, content);
+                    }
+
+                    ++dependency_count;
+                }
+
+                write_cache_int(data, dependency_count);
+                data += dependencies;
+
+                if (recording.cacheable)
+                    write_cache_entry(key, key_material, data);
+            }
+        }
+
+        stop_recording();
+    }
+
+    // Check that the file only wrote its output, and left everything else
+    // as it was.
+    bool include_cache::check_recording() const
+    {
+        return state.error_count == error_count &&
+            detail::message_count() == message_count &&
+            state.anchors.empty() &&
+            !state.callout_depth &&
+            !state.in_list &&
+            !state.explicit_list &&
+            !state.source_mode_next.check() &&
+            state.phrase.str().size() == phrase_size &&
+            state.out.str().size() >= out_size;
+    }
+
+    void include_cache::stop_recording()
+    {
+        assert(is_recording && state.recording == &recording);
+        is_recording = false;
+
+        include_recording* parent = recording.parent;
+        state.recording = parent;
+
+        if (parent) {
+            parent->cacheable = parent->cacheable && recording.cacheable;
+            parent->ids.insert(parent->ids.end(),
+                recording.ids.begin(), recording.ids.end());
+            parent->dependencies.insert(parent->dependencies.end(),
+                recording.dependencies.begin(), recording.dependencies.end());
+            state.ids->record(&parent->ids);
+            state.dependencies.recording = &parent->dependencies;
+        }
+        else {
+            state.ids->record(0);
+            state.dependencies.recording = 0;
+        }
+    }
+
+    void dont_cache_include(quickbook::state& state)
+    {
+        if (state.recording) state.recording->cacheable = false;
+    }
+}
@@ -0,0 +1,88 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_INCLUDE_CACHE_HPP)
+#define BOOST_QUICKBOOK_INCLUDE_CACHE_HPP
+
+#include <string>
+#include "fwd.hpp"
+#include "values.hpp"
+#include "id_manager.hpp"
+#include "dependency_tracker.hpp"
+
+namespace quickbook
+{
+    // The effects of parsing an included file, recorded while it's parsed.
+    // Included files can be nested, so when a recording finishes, what it
+    // recorded is added to the recording of the file that included it.
+    struct include_recording
+    {
+        include_recording() : parent(0), cacheable(true) {}
+
+        include_recording* parent;
+        bool cacheable;
+        id_changes ids;
+        dependency_tracker::added_dependencies dependencies;
+    };
+
+    // Caches the output of an included quickbook file in the on disk cache,
+    // so that it doesn't need to be parsed again when it's unchanged.
+    //
+    // An entry is keyed on the file's contents and everything it can see
+    // when it's included: the macros, templates, source mode, section
+    // level, paths and options. It stores the intermediate xml, the changes
+    // the file made to the ids and the files it depended on. It's only
+    // used if those files are unchanged, and the placeholders in the xml
+    // are renumbered for the ids created when the changes are repeated.
+    //
+    // A file is only stored if it was parsed without errors or warnings,
+    // and didn't do anything that repeating the output and id changes
+    // wouldn't do, see 'dont_cache_include'.
+    struct include_cache
+    {
+        // Call once the included file has been loaded into
+        // 'state.current_file', before it's parsed.
+        include_cache(quickbook::state&, value::tag_type load_type,
+                value const& include_doc_id);
+        ~include_cache();
+
+        // Repeats the effects of a cached parse. If this returns false,
+        // parse the file between calls to 'start_recording' and
+        // 'finish_recording', to store it for next time.
+        bool replay();
+
+        void start_recording();
+        void finish_recording();
+
+    private:
+        include_cache(include_cache const&);
+        include_cache& operator=(include_cache const&);
+
+        void stop_recording();
+        bool check_recording() const;
+
+        quickbook::state& state;
+        std::string key_material;   // Empty if the file can't be cached.
+        std::string key;
+        include_recording recording;
+        bool is_recording;
+
+        // Used to check what the file did when it was recorded.
+        std::string::size_type out_size;
+        std::string::size_type phrase_size;
+        int error_count;
+        unsigned message_count;
+    };
+
+    // Call when an included file does something that the include cache
+    // can't repeat, so that the files currently being recorded aren't
+    // stored.
+    void dont_cache_include(quickbook::state&);
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include "input_path.hpp"
 #include "utils.hpp"
 #include "files.hpp"
+#include "threads.hpp"
 
 #if QUICKBOOK_WIDE_PATHS || QUICKBOOK_WIDE_STREAMS
 #include <boost/scoped_ptr.hpp>
@@ -172,15 +173,15 @@ namespace detail {
         out << from_utf8(x);
     }
 
-    ostream& out()
-    {
-        static ostream x(std::wcout);
-        return x;
-    }
-
     namespace
     {
-        inline ostream& error_stream()
+        inline ostream& standard_output()
+        {
+            static ostream x(std::wcout);
+            return x;
+        }
+
+        inline ostream& standard_error()
         {
             static ostream x(std::wcerr);
             return x;
@@ -198,26 +199,88 @@ namespace detail {
         out << x;
     }
 
-    ostream& out()
+    namespace
     {
-        static ostream x(std::cout);
-        return x;
+        inline ostream& standard_output()
+        {
+            static ostream x(std::cout);
+            return x;
+        }
+
+        inline ostream& standard_error()
+        {
+            static ostream x(std::clog);
+            return x;
+        }
     }
 
+#endif
+
     namespace
     {
+        QUICKBOOK_THREAD_LOCAL output_capture* current_capture = 0;
+        QUICKBOOK_THREAD_LOCAL unsigned current_message_count = 0;
+
         inline ostream& error_stream()
         {
-            static ostream x(std::clog);
-            return x;
+            return current_capture ? current_capture->err_ : standard_error();
+        }
+
+        // The stream for an error or warning.
+        inline ostream& message_stream()
+        {
+            ++current_message_count;
+            return error_stream();
         }
     }
 
-#endif
+    unsigned message_count()
+    {
+        return current_message_count;
+    }
+
+    ostream& out()
+    {
+        return current_capture ? current_capture->out_ : standard_output();
+    }
+
+    output_capture::output_capture()
+        : out_buffer_(), err_buffer_(), out_(out_buffer_), err_(err_buffer_)
+    {}
+
+    void output_capture::start()
+    {
+        assert(!current_capture);
+        current_capture = this;
+    }
+
+    void output_capture::stop()
+    {
+        assert(current_capture == this);
+        current_capture = 0;
+    }
+
+    void output_capture::flush()
+    {
+        out().base << out_buffer_.str() << std::flush;
+        error_stream().base << err_buffer_.str() << std::flush;
+        out_buffer_.str(ostream::string());
+        err_buffer_.str(ostream::string());
+    }
+
+    ostream::string output_capture::output() const
+    {
+        return out_buffer_.str();
+    }
+
+    ostream::string output_capture::errors() const
+    {
+        return err_buffer_.str();
+    }
 
     ostream& outerr()
     {
-        return error_stream() << "Error: ";
+        return message_stream() << "Error: ";
     }
 
     ostream& outerr(fs::path const& file, int line)
@@ -225,13 +288,13 @@ namespace detail {
         if (line >= 0)
         {
             if (ms_errors)
-                return error_stream() << path_to_stream(file) << "(" << line << "): error: ";
+                return message_stream() << path_to_stream(file) << "(" << line << "): error: ";
             else
-                return error_stream() << path_to_stream(file) << ":" << line << ": error: ";
+                return message_stream() << path_to_stream(file) << ":" << line << ": error: ";
         }
         else
         {
-            return error_stream() << path_to_stream(file) << ": error: ";
+            return message_stream() << path_to_stream(file) << ": error: ";
         }
     }
 
@@ -245,13 +308,13 @@ namespace detail {
         if (line >= 0)
         {
             if (ms_errors)
-                return error_stream() << path_to_stream(file) << "(" << line << "): warning: ";
+                return message_stream() << path_to_stream(file) << "(" << line << "): warning: ";
             else
-                return error_stream() << path_to_stream(file) << ":" << line << ": warning: ";
+                return message_stream() << path_to_stream(file) << ":" << line << ": warning: ";
         }
         else
         {
-            return error_stream() << path_to_stream(file) << ": warning: ";
+            return message_stream() << path_to_stream(file) << ": warning: ";
         }
     }
 
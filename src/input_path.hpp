@@ -15,6 +15,7 @@
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <sstream>
 #include "fwd.hpp"
 
 #if defined(__cygwin__) || defined(__CYGWIN__)
@@ -130,6 +131,43 @@ namespace quickbook
         ostream& outwarn(fs::path const& file, int line = -1);
         ostream& outerr(file_ptr const&, string_iterator);
         ostream& outwarn(file_ptr const&, string_iterator);
+
+        // The number of errors and warnings written on the current thread,
+        // so that callers can tell if any were written while they ran.
+        unsigned message_count();
+
+        // Collects the messages written to 'out', 'outerr' and 'outwarn'
+        // on a thread, so that the messages from documents compiled in
+        // parallel can be written in order, rather than interleaved.
+        struct output_capture
+        {
+            output_capture();
+
+            // Start or stop capturing on the current thread.
+            void start();
+            void stop();
+
+            // Write the captured messages to the calling thread's output,
+            // which is usually the real output streams.
+            void flush();
+
+            // The messages captured so far.
+            ostream::string output() const;
+            ostream::string errors() const;
+
+        private:
+            output_capture(output_capture const&);
+            output_capture& operator=(output_capture const&);
+
+            typedef std::basic_ostringstream<
+                ostream::base_ostream::char_type> buffer;
+
+            buffer out_buffer_;
+            buffer err_buffer_;
+        public:
+            ostream out_;
+            ostream err_;
+        };
     }
 }
 
@@ -18,6 +18,7 @@
 #include "parsers.hpp"
 #include "scoped.hpp"
 #include "input_path.hpp"
+#include "quickbook.hpp"
 #include <boost/spirit/include/classic_core.hpp>
 #include <boost/spirit/include/classic_chset.hpp>
 #include <boost/spirit/include/classic_if.hpp>
@@ -83,6 +84,98 @@ namespace quickbook
         }
     };
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Plain text
+    //
+    // Most of a document is plain text, which 'common' would otherwise parse
+    // a character at a time, trying every alternative at each one. This
+    // matches a run of characters that can't start any markup, so that it
+    // can be written out in one go.
+    //
+    // A run has to start with a plain character, as leading whitespace is
+    // written without writing anchors. Blanks are only included when
+    // followed by more plain text, as some phrases end at whitespace
+    // followed by a bracket.
+
+    namespace
+    {
+        enum plain_text_class { plain_char, blank_char, markup_char };
+
+        struct plain_text_classes
+        {
+            unsigned char values[256];
+
+            plain_text_classes()
+            {
+                for (int i = 0; i < 256; ++i) values[i] = plain_char;
+                values[(unsigned char) ' '] = blank_char;
+                values[(unsigned char) '\t'] = blank_char;
+
+                // End of lines, other whitespace, and the characters
+                // that can start markup, escapes, comments or the end of
+                // a phrase.
+                for (char const* c = "\n\v\f\r[]*/_='`\\"; *c; ++c)
+                    values[(unsigned char) *c] = markup_char;
+            }
+        };
+
+        plain_text_classes const plain_text_table;
+    }
+
+    struct plain_text_parser : public cl::parser<plain_text_parser>
+    {
+        typedef plain_text_parser self_t;
+
+        template <typename Scanner>
+        struct result
+        {
+            typedef cl::match<> type;
+        };
+
+        explicit plain_text_parser(quickbook::state& state) : state_(state) {}
+
+        template <typename Scanner>
+        typename result<Scanner>::type parse(Scanner const& scan) const
+        {
+            typedef typename Scanner::iterator_t iterator_t;
+
+            string_iterator begin = scan.first.base();
+            string_iterator end = scan.last.base();
+            string_iterator run_end = begin;
+
+            for (string_iterator pos = begin; pos != end;) {
+                unsigned char c = plain_text_table.values[(unsigned char) *pos];
+
+                if (c == blank_char && run_end != begin) {
+                    ++pos;
+                }
+                else if (c == plain_char && !starts_macro(pos, end)) {
+                    run_end = ++pos;
+                }
+                else {
+                    break;
+                }
+            }
+
+            if (run_end == begin) return scan.no_match();
+
+            iterator_t save = scan.first;
+            while (scan.first.base() != run_end) ++scan.first;
+            return scan.create_match(run_end - begin, cl::nil_t(),
+                    save, scan.first);
+        }
+
+        // Macros can start with any character, so check for one at every
+        // position, as the 'macro' rule would.
+        bool starts_macro(string_iterator pos, string_iterator end) const
+        {
+            cl::scanner<string_iterator> scan(pos, end);
+            return state_.macro.find(scan) != 0;
+        }
+
+        quickbook::state& state_;
+    };
+
     struct main_grammar_local
     {
         ////////////////////////////////////////////////////////////////////////
@@ -116,10 +209,14 @@ namespace quickbook
                         template_args_1_6, template_arg_1_6, template_arg_1_6_content,
                         break_,
                         command_line_macro_identifier,
-                        dummy_block, line_dummy_block, square_brackets,
+                        square_brackets,
                         skip_escape
                         ;
 
+#if defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
+        cl::rule<scanner> dummy_block, line_dummy_block;
+#endif
+
         struct block_context_closure : cl::closure<block_context_closure,
             element_info::context>
         {
@@ -246,6 +343,67 @@ namespace quickbook
         bool element_context_error_;
     };
 
+    // Phrase elements in quickbook 1.6 and earlier fail softly, so when
+    // they're nested and not closed, each one is parsed as an element, then
+    // reparsed as plain text after it fails, which takes exponential time.
+    // When 'memoize_elements' is set, this remembers where an element has
+    // failed, so that it fails straight away if it's tried there again.
+    template <typename ParserT>
+    struct memoize_failure_parser
+        : public cl::unary< ParserT, cl::parser< memoize_failure_parser<ParserT> > >
+    {
+        typedef memoize_failure_parser<ParserT> self_t;
+        typedef cl::unary< ParserT, cl::parser< memoize_failure_parser<ParserT> > > base_t;
+
+        template <typename ScannerT>
+        struct result
+        {
+            typedef typename cl::parser_result<ParserT, ScannerT>::type type;
+        };
+
+        memoize_failure_parser(ParserT const& p, main_grammar_local& l)
+            : base_t(p), l(l) {}
+
+        template <typename ScannerT>
+        typename result<ScannerT>::type parse(ScannerT const& scan) const
+        {
+            if (!memoize_elements) return this->subject().parse(scan);
+
+            // Only memoize positions in the current file.
+            file_ptr const& file = l.state_.current_file;
+            string_iterator position = scan.first.base();
+            if (!file || position < file->source().begin() ||
+                    position > file->source().end())
+                return this->subject().parse(scan);
+
+            failed_element key(file, position - file->source().begin(),
+                l.context, l.no_eols);
+            failed_element_set& failures = l.state_.failed_elements;
+
+            if (failures.find(key) != failures.end())
+                return scan.no_match();
+
+            typename result<ScannerT>::type hit = this->subject().parse(scan);
+            if (!hit) failures.insert(key);
+            return hit;
+        }
+
+        main_grammar_local& l;
+    };
+
+    struct memoize_failure_gen
+    {
+        explicit memoize_failure_gen(main_grammar_local& l) : l(l) {}
+
+        template <typename ParserT>
+        memoize_failure_parser<ParserT> operator[](ParserT const& p) const
+        {
+            return memoize_failure_parser<ParserT>(p, l);
+        }
+
+        main_grammar_local& l;
+    };
+
     struct in_list_impl {
         main_grammar_local& l;
 
@@ -299,6 +457,12 @@ namespace quickbook
         main_grammar_local& local = cleanup_.add(
             new main_grammar_local(state));
 
+#if !defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
+        // Parsers are copied into the rules that use them, so this has to
+        // be set up first.
+        phrase_end = phrase_end_parser(local.no_eols);
+#endif
+
         // Global Actions
         quickbook::element_action element_action(state);
         quickbook::paragraph_action paragraph_action(state);
@@ -306,6 +470,7 @@ namespace quickbook
         phrase_end_action end_phrase(state);
         raw_char_action raw_char(state);
         plain_char_action plain_char(state);
+        plain_text_parser plain_text(state);
         escape_unicode_action escape_unicode(state);
 
         simple_phrase_action simple_markup(state);
@@ -320,6 +485,7 @@ namespace quickbook
 
         // Local Actions
         scoped_parser<process_element_impl> process_element(local);
+        memoize_failure_gen memoize_failure(local);
         in_list_impl in_list(local);
 
         set_scoped_value<main_grammar_local, bool> scoped_no_eols(
@@ -546,7 +712,8 @@ namespace quickbook
             ;
 
         local.element
-            =   '['
+            =   memoize_failure
+            [   '['
             >>  (   cl::eps_p(cl::punct_p)
                 >>  elements                    [ph::var(local.info) = ph::arg1]
                 |   elements                    [ph::var(local.info) = ph::arg1]
@@ -559,6 +726,7 @@ namespace quickbook
                     >>  ']'
                     ]                           [element_action]
                 ]
+            ]
             ;
 
         local.code =
@@ -584,14 +752,17 @@ namespace quickbook
             ;
 
         local.common =
-                local.macro
+                plain_text                  [plain_char]
+            |   local.macro
             |   local.element
             |   local.template_
             |   local.break_
             |   local.code_block
             |   local.inline_code
             |   local.simple_markup
-            |   escape
+            |   cl::eps_p(cl::chset<>("\\'")) >> escape
+                                                // only call escape when
+                                                // it might match
             |   comment
             |   qbk_ver(106u) >> local.square_brackets
             |   cl::space_p                 [raw_char]
@@ -971,6 +1142,7 @@ namespace quickbook
             (cl::eps_p - (cl::alnum_p | '_')) >> space
             ;
 
+#if defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
         space =
             *(cl::space_p | comment)
             ;
@@ -1005,6 +1177,7 @@ namespace quickbook
         local.line_dummy_block =
             '[' >> *(local.line_dummy_block | (cl::anychar_p - (cl::eol_p | ']'))) >> ']'
             ;
+#endif
 
         macro_identifier =
                 qbk_ver(106u)
@@ -1012,6 +1185,53 @@ namespace quickbook
             |   qbk_ver(0, 106u)
             >>  +(cl::anychar_p - (cl::space_p | ']'))
             ;
+
+#if defined(QUICKBOOK_PROFILE_RULES)
+        // The rules in quickbook_grammar::impl are added once they're all
+        // defined, in its constructor.
+        profiler.add(local.template_phrase, "template_phrase");
+        profiler.add(local.top_level, "top_level");
+        profiler.add(local.indent_check, "indent_check");
+        profiler.add(local.paragraph_separator, "paragraph_separator");
+        profiler.add(local.inside_paragraph, "local.inside_paragraph");
+        profiler.add(local.code, "code");
+        profiler.add(local.code_line, "code_line");
+        profiler.add(local.blank_line, "blank_line");
+        profiler.add(local.hr, "hr");
+        profiler.add(local.inline_code, "inline_code");
+        profiler.add(local.skip_inline_code, "skip_inline_code");
+        profiler.add(local.template_, "template_");
+        profiler.add(local.code_block, "code_block");
+        profiler.add(local.skip_code_block, "skip_code_block");
+        profiler.add(local.macro, "macro");
+        profiler.add(local.template_args, "template_args");
+        profiler.add(local.template_args_1_4, "template_args_1_4");
+        profiler.add(local.template_arg_1_4, "template_arg_1_4");
+        profiler.add(local.template_inner_arg_1_4, "template_inner_arg_1_4");
+        profiler.add(local.brackets_1_4, "brackets_1_4");
+        profiler.add(local.template_args_1_5, "template_args_1_5");
+        profiler.add(local.template_arg_1_5, "template_arg_1_5");
+        profiler.add(local.template_arg_1_5_content, "template_arg_1_5_content");
+        profiler.add(local.template_inner_arg_1_5, "template_inner_arg_1_5");
+        profiler.add(local.brackets_1_5, "brackets_1_5");
+        profiler.add(local.template_args_1_6, "template_args_1_6");
+        profiler.add(local.template_arg_1_6, "template_arg_1_6");
+        profiler.add(local.template_arg_1_6_content, "template_arg_1_6_content");
+        profiler.add(local.break_, "break_");
+        profiler.add(local.command_line_macro_identifier, "command_line_macro_identifier");
+        profiler.add(local.square_brackets, "square_brackets");
+        profiler.add(local.skip_escape, "skip_escape");
+        profiler.add(local.simple_markup, "simple_markup");
+        profiler.add(local.simple_markup_end, "simple_markup_end");
+        profiler.add(local.paragraph, "paragraph");
+        profiler.add(local.list, "list");
+        profiler.add(local.common, "common");
+        profiler.add(local.element, "element");
+#if defined(QUICKBOOK_DYNAMIC_LEXICAL_RULES)
+        profiler.add(local.dummy_block, "dummy_block");
+        profiler.add(local.line_dummy_block, "line_dummy_block");
+#endif
+#endif
     }
 
     ////////////////////////////////////////////////////////////////////////////
@@ -68,7 +68,12 @@ namespace quickbook
 
         markup const& get_markup(value::tag_type t)
         {
-            return markups[t];
+            // Only read from the map here, as it's shared by documents
+            // compiled in parallel.
+            static markup const no_markup = { value::default_tag, 0, 0 };
+            std::map<value::tag_type, markup>::const_iterator
+                pos = markups.find(t);
+            return pos != markups.end() ? pos->second : no_markup;
         }
 
         std::ostream& operator<<(std::ostream& out, markup const& m)
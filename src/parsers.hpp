@@ -18,6 +18,7 @@
 #include <boost/spirit/include/phoenix1_tuples.hpp>
 #include <boost/spirit/include/phoenix1_binders.hpp>
 #include "fwd.hpp"
+#include <iterator>
 
 namespace quickbook {
     namespace cl = boost::spirit::classic;
@@ -295,6 +296,232 @@ namespace quickbook {
     };
   
     u8_codepoint_parser const u8_codepoint_p = u8_codepoint_parser();
+
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    // Lexical parsers
+    //
+    // Hand written versions of the innermost rules in the main grammar,
+    // which are tried at almost every character. Unlike a rule they don't
+    // require a virtual call, and they're small enough to be inlined into
+    // the parsers that use them. Each one matches exactly what the rule
+    // in 'main_grammar.cpp' matches.
+    //
+    ///////////////////////////////////////////////////////////////////////////
+
+    namespace detail
+    {
+        // The characters matched by 'cl::space_p' and 'cl::blank_p' in the
+        // "C" locale.
+        inline bool is_space_char(char c)
+        {
+            return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        inline bool is_blank_char(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        // Matches 'cl::eol_p'.
+        template <typename Scanner>
+        bool parse_eol(Scanner const& scan)
+        {
+            if (scan.at_end()) return false;
+
+            if (*scan.first == '\r') {
+                ++scan.first;
+                if (!scan.at_end() && *scan.first == '\n') ++scan.first;
+                return true;
+            }
+            else if (*scan.first == '\n') {
+                ++scan.first;
+                return true;
+            }
+
+            return false;
+        }
+
+        // Matches a comment, in the grammar:
+        //
+        //     comment = "[/" >> *(dummy_block | (cl::anychar_p - ']')) >> ']';
+        //     dummy_block = '[' >> *(dummy_block | (cl::anychar_p - ']')) >> ']';
+        //
+        // As the kleene star never backtracks, this is the same as
+        // counting brackets. If 'single_line' is true, the comment can't
+        // contain an end of line.
+        template <typename Scanner>
+        bool parse_comment(Scanner const& scan, bool single_line)
+        {
+            typename Scanner::iterator_t save = scan.first;
+
+            if (scan.at_end() || *scan.first != '[') return false;
+            ++scan.first;
+            if (scan.at_end() || *scan.first != '/') {
+                scan.first = save;
+                return false;
+            }
+            ++scan.first;
+
+            for (unsigned int depth = 1; !scan.at_end(); ++scan.first) {
+                switch (*scan.first) {
+                case '[':
+                    ++depth;
+                    break;
+                case ']':
+                    if (--depth == 0) {
+                        ++scan.first;
+                        return true;
+                    }
+                    break;
+                case '\r':
+                case '\n':
+                    if (single_line) {
+                        scan.first = save;
+                        return false;
+                    }
+                    break;
+                }
+            }
+
+            scan.first = save;
+            return false;
+        }
+
+        // Matches '*(cl::space_p | comment)', or '*(cl::blank_p | comment)'
+        // if 'blank_only' is true.
+        template <typename Scanner>
+        void parse_space(Scanner const& scan, bool blank_only)
+        {
+            while (!scan.at_end()) {
+                char c = *scan.first;
+
+                if (blank_only ? is_blank_char(c) : is_space_char(c))
+                    ++scan.first;
+                else if (c != '[' || !parse_comment(scan, false))
+                    break;
+            }
+        }
+
+        template <typename Scanner>
+        cl::match<> lexical_match(Scanner const& scan,
+                typename Scanner::iterator_t const& save, bool hit)
+        {
+            if (!hit) {
+                scan.first = save;
+                return scan.no_match();
+            }
+
+            return scan.create_match(
+                    std::distance(save, scan.first), cl::nil_t(),
+                    save, scan.first);
+        }
+    }
+
+    template <typename Derived>
+    struct lexical_parser : public cl::parser<Derived>
+    {
+        template <typename Scanner>
+        struct result
+        {
+            typedef cl::match<> type;
+        };
+    };
+
+    // space = *(cl::space_p | comment)
+    struct space_parser : public lexical_parser<space_parser>
+    {
+        typedef space_parser self_t;
+
+        template <typename Scanner>
+        cl::match<> parse(Scanner const& scan) const
+        {
+            typename Scanner::iterator_t save = scan.first;
+            detail::parse_space(scan, false);
+            return detail::lexical_match(scan, save, true);
+        }
+    };
+
+    // blank = *(cl::blank_p | comment)
+    struct blank_parser : public lexical_parser<blank_parser>
+    {
+        typedef blank_parser self_t;
+
+        template <typename Scanner>
+        cl::match<> parse(Scanner const& scan) const
+        {
+            typename Scanner::iterator_t save = scan.first;
+            detail::parse_space(scan, true);
+            return detail::lexical_match(scan, save, true);
+        }
+    };
+
+    // eol = blank >> cl::eol_p
+    struct eol_parser : public lexical_parser<eol_parser>
+    {
+        typedef eol_parser self_t;
+
+        template <typename Scanner>
+        cl::match<> parse(Scanner const& scan) const
+        {
+            typename Scanner::iterator_t save = scan.first;
+            detail::parse_space(scan, true);
+            return detail::lexical_match(scan, save, detail::parse_eol(scan));
+        }
+    };
+
+    // comment = "[/" >> *(dummy_block | (cl::anychar_p - ']')) >> ']'
+    //
+    // line_comment is the same, but can't contain an end of line.
+    template <bool SingleLine>
+    struct comment_parser : public lexical_parser<comment_parser<SingleLine> >
+    {
+        typedef comment_parser self_t;
+
+        template <typename Scanner>
+        cl::match<> parse(Scanner const& scan) const
+        {
+            typename Scanner::iterator_t save = scan.first;
+            return detail::lexical_match(scan, save,
+                    detail::parse_comment(scan, SingleLine));
+        }
+    };
+
+    // phrase_end =
+    //         ']'
+    //     |   cl::eps_p(ph::var(no_eols))
+    //     >>  cl::eol_p >> *cl::blank_p >> cl::eol_p
+    //     ;
+    struct phrase_end_parser : public lexical_parser<phrase_end_parser>
+    {
+        typedef phrase_end_parser self_t;
+
+        phrase_end_parser() : no_eols_(0) {}
+        explicit phrase_end_parser(bool const& no_eols) : no_eols_(&no_eols) {}
+
+        template <typename Scanner>
+        cl::match<> parse(Scanner const& scan) const
+        {
+            typename Scanner::iterator_t save = scan.first;
+
+            if (scan.at_end()) return scan.no_match();
+
+            if (*scan.first == ']') {
+                ++scan.first;
+                return detail::lexical_match(scan, save, true);
+            }
+
+            if (!*no_eols_ || !detail::parse_eol(scan))
+                return detail::lexical_match(scan, save, false);
+
+            while (!scan.at_end() && detail::is_blank_char(*scan.first))
+                ++scan.first;
+
+            return detail::lexical_match(scan, save, detail::parse_eol(scan));
+        }
+
+        bool const* no_eols_;
+    };
 }
 
 #endif // BOOST_QUICKBOOK_SCOPED_BLOCK_HPP
@@ -12,6 +12,7 @@
 #include <set>
 #include <stack>
 #include <cctype>
+#include <ostream>
 
 namespace quickbook
 {
@@ -20,9 +21,13 @@ namespace quickbook
 
     struct printer
     {
-        printer(std::string& out, int& current_indent, int linewidth)
+        // Size at which the output is written to the stream.
+        static std::string::size_type const chunk_size = 65536;
+
+        printer(std::string& out, int& current_indent, int linewidth,
+                std::ostream* stream)
             : prev(0), out(out), current_indent(current_indent) , column(0)
-            , in_string(false), linewidth(linewidth) {}
+            , in_string(false), linewidth(linewidth), stream(stream) {}
 
         void indent()
         {
@@ -40,10 +45,19 @@ namespace quickbook
         void break_line()
         {
             trim_spaces();
+            if (stream && out.size() >= chunk_size) write();
             out += '\n';
             indent();
         }
 
+        // Only called at the end of a line, as the current line can still
+        // be changed.
+        void write()
+        {
+            stream->write(out.data(), out.size());
+            out.clear();
+        }
+
         bool line_is_empty() const
         {
             for (iter_type i = out.end()-(column-current_indent); i != out.end(); ++i)
@@ -175,6 +189,7 @@ namespace quickbook
         int column;
         bool in_string;
         int linewidth;
+        std::ostream* stream;
     };
 
     char const* block_tags_[] =
@@ -228,8 +243,10 @@ namespace quickbook
 
     struct tidy_compiler
     {
-        tidy_compiler(std::string& out, int linewidth)
-            : out(out), current_indent(0), printer_(out, current_indent, linewidth)
+        tidy_compiler(std::string& out, int linewidth,
+                std::ostream* stream = 0)
+            : out(out), current_indent(0)
+            , printer_(out, current_indent, linewidth, stream)
         {
             static int const n_block_tags = sizeof(block_tags_)/sizeof(char const*);
             for (int i = 0; i != n_block_tags; ++i)
@@ -430,28 +447,48 @@ namespace quickbook
         int indent;
     };
 
+    namespace
+    {
+        void post_process_impl(
+            std::string const& in
+          , std::string& out
+          , std::ostream* stream
+          , int indent
+          , int linewidth)
+        {
+            if (indent == -1)
+                indent = 2;         // set default to 2
+            if (linewidth == -1)
+                linewidth = 80;     // set default to 80
+
+            tidy_compiler state(out, linewidth, stream);
+            tidy_grammar g(state, indent);
+            cl::parse_info<iter_type> r = parse(in.begin(), in.end(), g, cl::space_p);
+            if (!r.full)
+            {
+                throw quickbook::post_process_failure("Post Processing Failed.");
+            }
+        }
+    }
+
     std::string post_process(
         std::string const& in
       , int indent
       , int linewidth)
     {
-        if (indent == -1)
-            indent = 2;         // set default to 2
-        if (linewidth == -1)
-            linewidth = 80;     // set default to 80
+        std::string tidy;
+        post_process_impl(in, tidy, 0, indent, linewidth);
+        return tidy;
+    }
 
+    void post_process(
+        std::string const& in
+      , std::ostream& out
+      , int indent
+      , int linewidth)
+    {
         std::string tidy;
-        tidy_compiler state(tidy, linewidth);
-        tidy_grammar g(state, indent);
-        cl::parse_info<iter_type> r = parse(in.begin(), in.end(), g, cl::space_p);
-        if (r.full)
-        {
-            return tidy;
-        }
-        else
-        {
-            throw quickbook::post_process_failure("Post Processing Failed.");
-        }
+        post_process_impl(in, tidy, &out, indent, linewidth);
+        out.write(tidy.data(), tidy.size());
     }
 }
-
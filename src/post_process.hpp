@@ -11,6 +11,7 @@
 
 #include <string>
 #include <stdexcept>
+#include <iosfwd>
 
 namespace quickbook
 {
@@ -19,6 +20,15 @@ namespace quickbook
       , int indent = -1
       , int linewidth = -1);
 
+    // Writes the output to the stream as it goes, rather than building it
+    // all up in memory first. So if this throws, some output will already
+    // have been written.
+    void post_process(
+        std::string const& in
+      , std::ostream& out
+      , int indent = -1
+      , int linewidth = -1);
+
     struct post_process_failure : public std::runtime_error
     {
     public:
@@ -0,0 +1,198 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "prefetch.hpp"
+#include "files.hpp"
+#include "input_path.hpp"
+#include "quickbook.hpp"
+#include "stat_cache.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace quickbook
+{
+    namespace
+    {
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        // If 'text' starts with 'keyword' followed by a space or an id,
+        // skip past it.
+        bool skip_keyword(boost::string_ref& text, char const* keyword)
+        {
+            std::size_t length = std::strlen(keyword);
+            if (text.size() <= length ||
+                    text.substr(0, length) != keyword ||
+                    !(is_space(text[length]) || text[length] == ':'))
+                return false;
+
+            text.remove_prefix(length);
+            return true;
+        }
+
+        // Reads a path up to the end of the element, or for images, the
+        // first space. Paths that contain markup are skipped.
+        boost::string_ref read_path(boost::string_ref text, bool is_image)
+        {
+            // An include id, as in '[include:id path]'.
+            if (!text.empty() && text[0] == ':') {
+                while (!text.empty() && !is_space(text[0]) && text[0] != ']')
+                    text.remove_prefix(1);
+            }
+
+            while (!text.empty() && is_space(text[0])) text.remove_prefix(1);
+
+            std::size_t end = 0;
+            while (end != text.size() && text[end] != ']' &&
+                    text[end] != '\n' && !(is_image && is_space(text[end])))
+            {
+                if (text[end] == '[' || text[end] == '\\')
+                    return boost::string_ref();
+                ++end;
+            }
+
+            if (end == text.size() || text[end] == '\n')
+                return boost::string_ref();
+
+            while (end && is_space(text[end - 1])) --end;
+            text = text.substr(0, end);
+
+            if (text.size() >= 2 && text[0] == '"' && text[end - 1] == '"')
+                text = text.substr(1, end - 2);
+
+            return text;
+        }
+    }
+
+    file_prefetcher::file_prefetcher(fs::path const& image_location,
+            unsigned thread_count)
+        : image_location(image_location), stopping(false)
+    {
+        for (unsigned i = 0; i < thread_count; ++i)
+            threads.create_thread(boost::bind(&file_prefetcher::run, this));
+    }
+
+    file_prefetcher::~file_prefetcher()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        ready.notify_all();
+        threads.join_all();
+    }
+
+    void file_prefetcher::scan(file_ptr const& f)
+    {
+        boost::string_ref source = f->source();
+        fs::path directory = f->path.parent_path();
+
+        for (boost::string_ref::const_iterator it = source.begin();
+            (it = std::find(it, source.end(), '[')) != source.end(); ++it)
+        {
+            boost::string_ref text(it + 1, source.end() - it - 1);
+            bool is_image = false;
+
+            if (!text.empty() && text[0] == '$') {
+                text.remove_prefix(1);
+                is_image = true;
+            }
+            else if (!skip_keyword(text, "include") &&
+                    !skip_keyword(text, "import")) {
+                continue;
+            }
+
+            boost::string_ref path_text = read_path(text, is_image);
+            if (path_text.empty()) continue;
+
+            fs::path path = detail::generic_to_path(path_text);
+            request r(is_image);
+
+            if (is_image) {
+                // Only SVG files are read, from the image location.
+                if (path.extension() != ".svg") continue;
+                r.paths.push_back(path.has_root_directory() ?
+                    path : image_location / path);
+            }
+            else if (path.has_root_directory() || path.has_root_name()) {
+                r.paths.push_back(path);
+            }
+            else {
+                // Same search order as 'include_search', but the files are
+                // checked in the worker thread.
+                r.paths.push_back(directory / path);
+                BOOST_FOREACH(fs::path const& p, include_path)
+                    r.paths.push_back(p / path);
+            }
+
+            add(r);
+        }
+    }
+
+    void file_prefetcher::add(request const& r)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            if (!seen.insert(r.paths.front()).second) return;
+            queue.push_back(r);
+        }
+
+        ready.notify_one();
+    }
+
+    void file_prefetcher::run()
+    {
+        for (;;)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !stopping) ready.wait(lock);
+            if (stopping) return;
+
+            request r = queue.front();
+            queue.pop_front();
+            lock.unlock();
+
+            fetch(r);
+        }
+    }
+
+    void file_prefetcher::fetch(request const& r)
+    {
+        try {
+            std::vector<fs::path>::const_iterator path = r.paths.begin();
+            while (path != r.paths.end() && !cached_is_regular_file(*path))
+                ++path;
+            if (path == r.paths.end()) return;
+
+            if (r.is_image) {
+                // SVG files aren't cached, but reading them gets them into
+                // the operating system's cache.
+                fs::ifstream in(*path, std::ios_base::binary);
+                char buffer[4096];
+                while (in.read(buffer, sizeof(buffer))) {}
+                return;
+            }
+
+            file_ptr f = load(*path);
+
+            std::string ext = path->extension().generic_string();
+            if (ext == ".qbk" || ext == ".quickbook") scan(f);
+        }
+        catch (std::exception&) {
+            // Errors are reported when the parser loads the file.
+        }
+    }
+}
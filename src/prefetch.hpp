@@ -0,0 +1,67 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_PREFETCH_HPP)
+#define BOOST_QUICKBOOK_PREFETCH_HPP
+
+#include <deque>
+#include <set>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "fwd.hpp"
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // Loads the files that a document includes and imports in background
+    // threads, so that they've already been read by the time the parser
+    // gets to them. They're found by a quick scan of the source, which
+    // doesn't have to be exact: anything it gets wrong is just loaded
+    // as normal.
+    struct file_prefetcher
+    {
+        file_prefetcher(fs::path const& image_location, unsigned threads);
+
+        // Stops the threads, waiting for any files that are being loaded.
+        ~file_prefetcher();
+
+        // Prefetch the files that 'f' refers to, and the ones they refer to.
+        void scan(file_ptr const& f);
+
+    private:
+        file_prefetcher(file_prefetcher const&);
+        file_prefetcher& operator=(file_prefetcher const&);
+
+        // A file to fetch, the first of 'paths' that exists.
+        struct request
+        {
+            explicit request(bool is_image) : paths(), is_image(is_image) {}
+
+            std::vector<fs::path> paths;
+            bool is_image;
+        };
+
+        void add(request const&);
+        void run();
+        void fetch(request const&);
+
+        fs::path image_location;
+        boost::mutex mutex;
+        boost::condition_variable ready;
+        std::deque<request> queue;
+        std::set<fs::path> seen;
+        bool stopping;
+        boost::thread_group threads;
+    };
+}
+
+#endif
@@ -16,6 +16,15 @@
 #include "files.hpp"
 #include "input_path.hpp"
 #include "id_manager.hpp"
+#include "server.hpp"
+#include "watch.hpp"
+#include "timings.hpp"
+#include "trace.hpp"
+#include "template_stats.hpp"
+#include "prefetch.hpp"
+#include "disk_cache.hpp"
+#include "stat_cache.hpp"
+#include "version.hpp"
 #include <boost/program_options.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -26,6 +35,15 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/tokenizer.hpp>
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <stdexcept>
 #include <vector>
@@ -40,21 +58,20 @@
 #pragma warning(disable:4355)
 #endif
 
-#define QUICKBOOK_VERSION "Quickbook Version 1.6.0 beta 1"
-
 namespace quickbook
 {
     namespace cl = boost::spirit::classic;
     namespace fs = boost::filesystem;
+    namespace po = boost::program_options;
 
     tm* current_time; // the current time
     tm* current_gm_time; // the current UTC time
     bool debug_mode; // for quickbook developers only
     bool self_linked_headers;
+    bool memoize_elements = false;
     bool ms_errors = false; // output errors/warnings as if for VS
     std::vector<fs::path> include_path;
     std::vector<std::string> preset_defines;
-    fs::path image_location;
 
     static void set_macros(quickbook::state& state)
     {
@@ -119,16 +136,149 @@ namespace quickbook
             indent(-1),
             linewidth(-1),
             pretty_print(true),
-            deps_out_flags(quickbook::dependency_tracker::default_)
+            show_timings(false),
+            show_template_stats(false),
+            prefetch(false),
+            show_file_cache_stats(false),
+            deps_out_flags(quickbook::dependency_tracker::default_),
+            watched_files(0)
         {}
 
         int indent;
         int linewidth;
         bool pretty_print;
+        bool show_timings;
+        bool show_template_stats;
+        bool prefetch;
+        bool show_file_cache_stats;
         fs::path deps_out;
         quickbook::dependency_tracker::flags deps_out_flags;
         fs::path locations_out;
+        fs::path trace_out;
         fs::path xinclude_base;
+        fs::path image_location;
+        // If set, filled with the document's dependencies, for watch mode.
+        dependency_tracker::dependency_list* watched_files;
+    };
+
+    // Generate the ids, pretty print and write out the document. Only one
+    // copy of the document is needed at a time, the output is written to
+    // the file as it's generated.
+    static int
+    write_output(
+        fs::path const& fileout_
+      , string_stream& buffer
+      , id_manager& ids
+      , parse_document_options const& options_
+      , timings* timings_)
+    {
+        std::string stage2;
+
+        if (options_.pretty_print)
+        {
+            stage2 = ids.replace_placeholders(buffer.str(), timings_);
+
+            // Free the original output.
+            std::string discard;
+            buffer.swap(discard);
+        }
+
+        fs::ofstream fileout(fileout_);
+
+        if (fileout.fail()) {
+            ::quickbook::detail::outerr()
+                << "Error opening output file "
+                << fileout_
+                << std::endl;
+
+            return 1;
+        }
+
+        // When timing, writes go through a stream buffer that times them.
+        timed_streambuf timed_buffer(fileout.rdbuf());
+        if (timings_) fileout.std::ios::rdbuf(&timed_buffer);
+
+        if (options_.pretty_print)
+        {
+            timed_phase phase(timings_, "post_process", stage2.size());
+
+            try
+            {
+                post_process(stage2, fileout, options_.indent,
+                    options_.linewidth);
+                phase.set_bytes_out(timed_buffer.bytes());
+            }
+            catch (quickbook::post_process_failure&)
+            {
+                // fallback! Replace the partial output.
+                ::quickbook::detail::outerr()
+                    << "Post Processing Failed."
+                    << std::endl;
+                timed_buffer.discard();
+                fileout.close();
+                fileout.open(fileout_);
+                fileout << stage2;
+                return 1;
+            }
+        }
+        else
+        {
+            ids.replace_placeholders(buffer.str(), fileout, timings_);
+        }
+
+        fileout.flush();
+
+        if (timings_)
+        {
+            timings_->add_phase("write", timed_buffer.elapsed(),
+                0, timed_buffer.bytes());
+        }
+
+        if (fileout.fail()) {
+            ::quickbook::detail::outerr()
+                << "Error writing to output file "
+                << fileout_
+                << std::endl;
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Building the grammar is expensive, so each thread keeps its state,
+    // which owns the grammar, and resets it for the next document.
+    static boost::thread_specific_ptr<quickbook::state> pooled_state;
+
+    static quickbook::state& get_state(fs::path const& filein_,
+            fs::path const& xinclude_base, string_stream& buffer,
+            id_manager& ids)
+    {
+        if (!pooled_state.get()) {
+            pooled_state.reset(new quickbook::state(
+                filein_, xinclude_base, buffer, ids));
+        }
+        else {
+            pooled_state->reset(filein_, xinclude_base, buffer, ids);
+        }
+
+        return *pooled_state;
+    }
+
+    // Discards the thread's state if an exception is thrown while it's in
+    // use, as it could have been left part way through a document. This
+    // includes exceptions that 'parse_document' doesn't handle, such as
+    // 'std::bad_alloc', which are caught by the batch queue.
+    struct pooled_state_guard
+    {
+        pooled_state_guard() : finished(false) {}
+        ~pooled_state_guard() { if (!finished) pooled_state.reset(); }
+
+        bool finished;
+
+    private:
+        pooled_state_guard(pooled_state_guard const&);
+        pooled_state_guard& operator=(pooled_state_guard const&);
     };
 
     static int
@@ -139,18 +289,55 @@ namespace quickbook
     {
         string_stream buffer;
         id_manager ids;
+        boost::scoped_ptr<timings> document_timings(
+            options_.show_timings ? new timings() : 0);
+        boost::scoped_ptr<template_stats> document_template_stats(
+            options_.show_template_stats ? new template_stats() : 0);
 
         int result = 0;
 
+        // Reset the version, in case a previous document in the batch set it.
+        qbk_version_n = 0;
+
+        pooled_state_guard state_guard;
+
         try {
-            quickbook::state state(filein_, options_.xinclude_base, buffer, ids);
+            boost::scoped_ptr<trace> tracer;
+            if (!options_.trace_out.empty())
+                tracer.reset(new trace(options_.trace_out));
+
+            quickbook::state& state = get_state(filein_,
+                    options_.xinclude_base, buffer, ids);
+            state.image_location = options_.image_location;
+            state.phase_timings = document_timings.get();
+            state.tracer = tracer.get();
+            state.template_statistics = document_template_stats.get();
             set_macros(state);
 
             if (state.error_count == 0) {
                 state.dependencies.add_dependency(filein_);
-                state.current_file = load(filein_); // Throws load_error
 
-                parse_file(state);
+                {
+                    timed_phase phase(state.phase_timings, "load");
+                    state.current_file = load(filein_); // Throws load_error
+                    phase.set_bytes_in(state.current_file->source().size());
+                }
+
+                boost::scoped_ptr<file_prefetcher> prefetcher;
+                if (options_.prefetch) {
+                    prefetcher.reset(
+                        new file_prefetcher(options_.image_location, 2));
+                    prefetcher->scan(state.current_file);
+                }
+
+                {
+                    timed_phase phase(state.phase_timings, "parse_file",
+                            state.current_file->source().size());
+                    trace_span span(state.tracer, "document",
+                            detail::path_to_generic(filein_));
+                    parse_file(state);
+                    phase.set_bytes_out(buffer.str().size());
+                }
 
                 if(state.error_count) {
                     detail::outerr()
@@ -172,9 +359,19 @@ namespace quickbook
                 state.dependencies.write_dependencies(options_.locations_out,
                         dependency_tracker::checked);
             }
+
+            if (options_.watched_files)
+            {
+                *options_.watched_files = state.dependencies.get_dependencies();
+            }
+
+            // The state is kept for the thread's next document, so release
+            // this one rather than leaving it until then.
+            state.clear();
+            state_guard.finished = true;
         }
         catch (load_error& e) {
-            detail::outerr(filein_) << e.what() << std::endl;
+            detail::outerr(filein_, e.line) << e.what() << std::endl;
             result = 1;
         }
         catch (std::runtime_error& e) {
@@ -184,171 +381,365 @@ namespace quickbook
 
         if (!fileout_.empty() && result == 0)
         {
-            std::string stage2 = ids.replace_placeholders(buffer.str());
+            result = write_output(fileout_, buffer, ids, options_,
+                    document_timings.get());
+        }
+
+        if (document_timings)
+        {
+            document_timings->write_report(filein_);
+        }
 
-            fs::ofstream fileout(fileout_);
+        if (document_template_stats)
+        {
+            document_template_stats->write_report();
+        }
 
-            if (fileout.fail()) {
-                ::quickbook::detail::outerr()
-                    << "Error opening output file "
-                    << fileout_
-                    << std::endl;
+        if (options_.show_file_cache_stats)
+        {
+            // Shared by every document in the process, so this is the
+            // total so far.
+            file_cache_stats stats = get_file_cache_stats();
+            std::ostringstream report;
+            report << "File cache: "
+                << stats.files << " files, "
+                << stats.bytes << " bytes, "
+                << stats.hits << " hits, "
+                << stats.misses << " misses, "
+                << stats.evictions << " evictions\n";
+            detail::out() << report.str() << std::flush;
+        }
 
-                return 1;
-            }
+        return result;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    //  Batch mode
+    //
+    ///////////////////////////////////////////////////////////////////////////
+
+    struct batch_entry
+    {
+        batch_entry(fs::path const& in, fs::path const& out)
+            : filein(in), fileout(out) {}
+
+        fs::path filein;
+        fs::path fileout;
+    };
+
+    // Read a batch file. Each line contains an input file, optionally
+    // followed by an output file, separated by whitespace. Paths containing
+    // spaces can be quoted. Empty lines and lines starting with '#' are
+    // ignored.
+    static bool read_batch_file(fs::path const& filename,
+            std::vector<batch_entry>& entries)
+    {
+        fs::ifstream in(filename);
+
+        if (!in) {
+            detail::outerr(filename) << "Could not open batch file." << std::endl;
+            return false;
+        }
 
-            if (options_.pretty_print)
+        typedef boost::escaped_list_separator<char> separator;
+        typedef boost::tokenizer<separator> tokenizer;
+
+        bool success = true;
+        std::string line;
+        int line_number = 0;
+
+        while (std::getline(in, line))
+        {
+            ++line_number;
+
+            std::vector<std::string> fields;
+
+            BOOST_FOREACH(std::string const& field,
+                    tokenizer(line, separator("", " \t\r", "\"")))
             {
-                try
-                {
-                    fileout << post_process(stage2, options_.indent,
-                        options_.linewidth);
-                }
-                catch (quickbook::post_process_failure&)
-                {
-                    // fallback!
-                    ::quickbook::detail::outerr()
-                        << "Post Processing Failed."
-                        << std::endl;
-                    fileout << stage2;
-                    return 1;
-                }
+                if (!field.empty()) fields.push_back(field);
             }
-            else
+
+            if (fields.empty() || fields[0][0] == '#') continue;
+
+            if (fields.size() > 2) {
+                detail::outerr(filename, line_number)
+                    << "Too many fields in batch file entry." << std::endl;
+                success = false;
+                continue;
+            }
+
+            fs::path filein = detail::generic_to_path(fields[0]);
+            fs::path fileout;
+
+            if (fields.size() > 1) {
+                fileout = detail::generic_to_path(fields[1]);
+            }
+            else {
+                fileout = filein;
+                fileout.replace_extension(".xml");
+            }
+
+            entries.push_back(batch_entry(filein, fileout));
+        }
+
+        if (in.bad()) {
+            detail::outerr(filename) << "Error reading batch file." << std::endl;
+            return false;
+        }
+
+        return success;
+    }
+
+    // Compile a single document from the batch. Returns true on success.
+    static bool
+    parse_batch_entry(
+        batch_entry const& entry
+      , parse_document_options options
+      , bool default_xinclude_base
+      , bool default_image_location)
+    {
+        if (default_xinclude_base)
+        {
+            options.xinclude_base = entry.fileout.parent_path();
+            if (options.xinclude_base.empty())
+                options.xinclude_base = ".";
+        }
+
+        if (default_image_location)
+        {
+            options.image_location = entry.filein.parent_path() / "html";
+        }
+
+        detail::out() << "Generating Output File: "
+            << entry.fileout
+            << std::endl;
+
+        if (!fs::is_directory(options.xinclude_base))
+        {
+            detail::outerr(entry.filein)
+                << (default_xinclude_base ?
+                    "parent directory not found for output file" :
+                    "xinclude-base is not a directory")
+                << std::endl;
+            return false;
+        }
+
+        return !parse_document(entry.filein, entry.fileout, options);
+    }
+
+    // The documents in a batch which is compiled in parallel. Idle workers
+    // take the next document from the queue, so that a long document doesn't
+    // hold up the others. The messages for each document are captured and
+    // written out in batch order, so the output is the same as a serial run.
+    struct batch_queue
+    {
+        batch_queue(
+            std::vector<batch_entry> const& entries
+          , parse_document_options const& options
+          , bool default_xinclude_base
+          , bool default_image_location)
+            : entries(entries)
+            , options(options)
+            , default_xinclude_base(default_xinclude_base)
+            , default_image_location(default_image_location)
+            , next(0)
+            , results(entries.size())
+        {}
+
+        struct result
+        {
+            result() : done(false), success(false) {}
+
+            bool done;
+            bool success;
+            detail::output_capture messages;
+        };
+
+        std::vector<batch_entry> const& entries;
+        parse_document_options const& options;
+        bool default_xinclude_base;
+        bool default_image_location;
+
+        boost::mutex mutex;
+        boost::condition_variable finished;
+        std::vector<batch_entry>::size_type next;
+        boost::ptr_vector<result> results;
+
+        void run();
+        bool wait_for(std::vector<batch_entry>::size_type);
+
+    private:
+        batch_queue(batch_queue const&);
+        batch_queue& operator=(batch_queue const&);
+    };
+
+    void batch_queue::run()
+    {
+        for(;;)
+        {
+            std::vector<batch_entry>::size_type i;
+
             {
-                fileout << stage2;
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if (next == entries.size()) return;
+                i = next++;
             }
 
-            if (fileout.fail()) {
-                ::quickbook::detail::outerr()
-                    << "Error writing to output file "
-                    << fileout_
-                    << std::endl;
+            result& r = results[i];
+            bool success = false;
 
-                return 1;
+            r.messages.start();
+
+            try {
+                success = parse_batch_entry(entries[i], options,
+                    default_xinclude_base, default_image_location);
             }
+            catch (std::exception& e) {
+                detail::outerr() << e.what() << "\n";
+            }
+
+            r.messages.stop();
+
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                r.success = success;
+                r.done = true;
+            }
+
+            finished.notify_all();
         }
+    }
 
-        return result;
+    bool batch_queue::wait_for(std::vector<batch_entry>::size_type i)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!results[i].done) finished.wait(lock);
+        return results[i].success;
     }
-}
 
-///////////////////////////////////////////////////////////////////////////
-//
-//  Main program
-//
-///////////////////////////////////////////////////////////////////////////
-int
-main(int argc, char* argv[])
-{
-    try
+    // Compile every document in the batch in this process, so that the
+    // markups and the loaded file cache are only set up once. Returns the
+    // number of documents which failed.
+    static int
+    parse_batch(
+        std::vector<batch_entry> const& entries
+      , parse_document_options const& options
+      , bool default_xinclude_base
+      , bool default_image_location
+      , unsigned jobs)
     {
-        namespace fs = boost::filesystem;
-        namespace po = boost::program_options;
+        int failures = 0;
 
-        using boost::program_options::options_description;
-        using boost::program_options::variables_map;
-        using boost::program_options::store;
-        using boost::program_options::parse_command_line;
-        using boost::program_options::wcommand_line_parser;
-        using boost::program_options::command_line_parser;
-        using boost::program_options::notify;
-        using boost::program_options::positional_options_description;
-        
-        using quickbook::detail::input_string;
+        if (jobs <= 1 || entries.size() <= 1)
+        {
+            BOOST_FOREACH(batch_entry const& entry, entries)
+            {
+                if (!parse_batch_entry(entry, options,
+                        default_xinclude_base, default_image_location))
+                    ++failures;
+            }
+        }
+        else
+        {
+            batch_queue queue(entries, options,
+                default_xinclude_base, default_image_location);
 
-        // First thing, the filesystem should record the current working directory.
-        fs::initial_path<fs::path>();
-        
-        // Various initialisation methods
-        quickbook::detail::initialise_output();
-        quickbook::detail::initialise_markups();
+            for (std::vector<batch_entry>::size_type i = 0;
+                    i < entries.size(); ++i)
+            {
+                queue.results.push_back(new batch_queue::result());
+            }
 
-        // Declare the program options
+            boost::thread_group workers;
 
-        options_description desc("Allowed options");
-        options_description hidden("Hidden options");
-        options_description all("All options");
+            for (unsigned i = 0; i < jobs && i < entries.size(); ++i)
+                workers.create_thread(boost::bind(&batch_queue::run, &queue));
 
-#if QUICKBOOK_WIDE_PATHS
-#define PO_VALUE po::wvalue
-#else
-#define PO_VALUE po::value
-#endif
+            for (std::vector<batch_entry>::size_type i = 0;
+                    i < entries.size(); ++i)
+            {
+                if (!queue.wait_for(i)) ++failures;
+                queue.results[i].messages.flush();
+            }
 
-        desc.add_options()
-            ("help", "produce help message")
-            ("version", "print version string")
-            ("no-pretty-print", "disable XML pretty printing")
-            ("no-self-linked-headers", "stop headers linking to themselves")
-            ("indent", PO_VALUE<int>(), "indent spaces")
-            ("linewidth", PO_VALUE<int>(), "line width")
-            ("input-file", PO_VALUE<input_string>(), "input file")
-            ("output-file", PO_VALUE<input_string>(), "output file")
-            ("output-deps", PO_VALUE<input_string>(), "output dependency file")
-            ("debug", "debug mode (for developers)")
-            ("ms-errors", "use Microsoft Visual Studio style error & warn message format")
-            ("include-path,I", PO_VALUE< std::vector<input_string> >(), "include path")
-            ("define,D", PO_VALUE< std::vector<input_string> >(), "define macro")
-            ("image-location", PO_VALUE<input_string>(), "image location")
-        ;
+            workers.join_all();
+        }
 
-        hidden.add_options()
-            ("expect-errors",
-                "Succeed if the input file contains a correctly handled "
-                "error, fail otherwise.")
-            ("xinclude-base", PO_VALUE<input_string>(),
-                "Generate xincludes as if generating for this target "
-                "directory.")
-            ("output-deps-format", PO_VALUE<input_string>(),
-             "Comma separated list of formatting options for output-deps, "
-             "options are: escaped, checked")
-            ("output-checked-locations", PO_VALUE<input_string>(),
-             "Writes a file listing all the file locations that were "
-             "checked, starting with '+' if they were found, or '-' "
-             "if they weren't.\n"
-             "This is deprecated, use 'output-deps-format=checked' to "
-             "write the deps file in this format.")
-        ;
+        if (failures) {
+            detail::outerr()
+                << failures << " of " << entries.size()
+                << " documents failed." << std::endl;
+        }
 
-        all.add(desc).add(hidden);
+        return failures;
+    }
+#if QUICKBOOK_WATCH
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    //  Watch mode
+    //
+    ///////////////////////////////////////////////////////////////////////////
 
-        positional_options_description p;
-        p.add("input-file", -1);
+    // Build the document, and then rebuild it whenever one of its
+    // dependencies changes. Only returns if watching fails.
+    static int
+    watch_document(
+        fs::path const& filein
+      , fs::path const& fileout
+      , parse_document_options options)
+    {
+        namespace pt = boost::posix_time;
 
-        // Read option from the command line
+        dependency_tracker::dependency_list files;
+        options.watched_files = &files;
 
-        variables_map vm;
+        // Files will be edited while they're loaded.
+        use_memory_mapped_files(false);
 
-#if QUICKBOOK_WIDE_PATHS
-        quickbook::ignore_variable(&argc);
-        quickbook::ignore_variable(&argv);
+        parse_document(filein, fileout, options);
+
+        for (;;)
+        {
+            // If the document couldn't be loaded, there are no dependencies,
+            // so just wait for it to appear.
+            if (files.empty())
+                files[fs::absolute(filein)] = fs::exists(filein);
+
+            file_stamps stamps = stamp_files(files);
+
+            detail::out() << "Watching " << files.size() << " files."
+                << std::endl;
+
+            if (!wait_for_change(stamps)) return 1;
+
+            pt::ptime start = pt::microsec_clock::universal_time();
+            files.clear();
+            check_loaded_files();
+            clear_stat_cache();
 
-        int wide_argc;
-        LPWSTR* wide_argv = CommandLineToArgvW(GetCommandLineW(), &wide_argc);
-        if (!wide_argv)
-        {
-            quickbook::detail::outerr() << "Error getting argument values." << std::endl;
-            return 1;
-        }
+            detail::out() << "Rebuilding: " << fileout << std::endl;
 
-        store(
-            wcommand_line_parser(wide_argc, wide_argv)
-                .options(all)
-                .positional(p)
-                .run(), vm);
+            int result = parse_document(filein, fileout, options);
+            pt::time_duration elapsed =
+                pt::microsec_clock::universal_time() - start;
 
-        LocalFree(wide_argv);
-#else
-        store(command_line_parser(argc, argv)
-                .options(all)
-                .positional(p)
-                .run(), vm);
+            detail::out()
+                << (result ? "Rebuild failed after " : "Rebuilt in ")
+                << static_cast<long>(elapsed.total_milliseconds())
+                << "ms." << std::endl;
+        }
+    }
 #endif
 
-        notify(vm);
-
-        // Process the command line options
+    // Process the command line options.
+    static int
+    process_options(
+        po::variables_map const& vm
+      , po::options_description const& desc)
+    {
+        using detail::input_string;
 
         quickbook::parse_document_options parse_document_options;
         bool expect_errors = vm.count("expect-errors");
@@ -378,12 +769,69 @@ main(int argc, char* argv[])
             return 0;
         }
 
-        if (vm.count("ms-errors"))
-            quickbook::ms_errors = true;
+        quickbook::ms_errors = vm.count("ms-errors");
+
+        if (vm.count("timings"))
+            parse_document_options.show_timings = true;
+
+        if (vm.count("template-stats"))
+            parse_document_options.show_template_stats = true;
 
         if (vm.count("no-pretty-print"))
             parse_document_options.pretty_print = false;
 
+        if (vm.count("prefetch"))
+            parse_document_options.prefetch = true;
+
+        quickbook::memoize_elements = vm.count("memoize-elements");
+
+        if (vm.count("file-cache-stats"))
+            parse_document_options.show_file_cache_stats = true;
+
+        // The caches are shared by every request to the server, so their
+        // settings are reset for each one rather than only set when given.
+        boost::uintmax_t file_cache_size = quickbook::default_file_cache_size;
+
+        if (vm.count("file-cache-size"))
+        {
+            int size = vm["file-cache-size"].as<int>();
+
+            if (size < 0)
+            {
+                quickbook::detail::outerr()
+                    << "Invalid file cache size: " << size << std::endl;
+                ++error_count;
+            }
+            else
+            {
+                file_cache_size = boost::uintmax_t(size) * 1024 * 1024;
+            }
+        }
+
+        quickbook::set_file_cache_size(file_cache_size);
+
+        fs::path cache_dir;
+
+        if (vm.count("cache-dir"))
+        {
+            cache_dir = quickbook::detail::input_to_path(
+                vm["cache-dir"].as<input_string>());
+            boost::system::error_code ec;
+            fs::create_directories(cache_dir, ec);
+
+            if (ec)
+            {
+                quickbook::detail::outerr()
+                    << "Unable to create cache directory "
+                    << cache_dir
+                    << ": " << ec.message() << std::endl;
+                ++error_count;
+                cache_dir.clear();
+            }
+        }
+
+        quickbook::set_cache_dir(cache_dir);
+
         quickbook::self_linked_headers = !vm.count("no-self-link-headers");
 
         if (vm.count("indent"))
@@ -410,8 +858,9 @@ main(int argc, char* argv[])
         else
         {
             time_t t = std::time(0);
-            static tm lt = *localtime(&t);
-            static tm gmt = *gmtime(&t);
+            static tm lt, gmt;
+            lt = *localtime(&t);
+            gmt = *gmtime(&t);
             quickbook::current_time = &lt;
             quickbook::current_gm_time = &gmt;
             quickbook::debug_mode = false;
@@ -435,7 +884,85 @@ main(int argc, char* argv[])
                 quickbook::detail::input_to_utf8);
         }
 
-        if (vm.count("input-file"))
+        if (vm.count("batch"))
+        {
+            if (vm.count("input-file") || vm.count("output-file") ||
+                    vm.count("output-deps") ||
+                    vm.count("output-checked-locations") ||
+                    vm.count("trace-out"))
+            {
+                quickbook::detail::outerr()
+                    << "--batch can't be used with input, output, "
+                    "dependency or trace files."
+                    << std::endl;
+                return 1;
+            }
+
+            if (vm.count("watch"))
+            {
+                quickbook::detail::outerr()
+                    << "--watch can't be used with --batch."
+                    << std::endl;
+                return 1;
+            }
+
+            if (vm.count("xinclude-base"))
+            {
+                parse_document_options.xinclude_base =
+                    quickbook::detail::input_to_path(
+                        vm["xinclude-base"].as<input_string>());
+            }
+
+            if (vm.count("image-location"))
+            {
+                parse_document_options.image_location =
+                    quickbook::detail::input_to_path(
+                        vm["image-location"].as<input_string>());
+            }
+
+            unsigned jobs = 1;
+
+            if (vm.count("jobs"))
+            {
+                int j = vm["jobs"].as<int>();
+
+                if (j < 0) {
+                    quickbook::detail::outerr()
+                        << "Invalid number of jobs: " << j << std::endl;
+                    return 1;
+                }
+
+                jobs = j ? j : boost::thread::hardware_concurrency();
+            }
+
+            std::vector<quickbook::batch_entry> entries;
+
+            if (!quickbook::read_batch_file(
+                    quickbook::detail::input_to_path(
+                        vm["batch"].as<input_string>()),
+                    entries))
+            {
+                ++error_count;
+            }
+
+            if (!error_count)
+                error_count += quickbook::parse_batch(entries,
+                        parse_document_options,
+                        !vm.count("xinclude-base"),
+                        !vm.count("image-location"),
+                        jobs);
+
+            if (expect_errors)
+            {
+                if (!error_count) quickbook::detail::outerr() << "No errors detected for --expect-errors." << std::endl;
+                return !error_count;
+            }
+            else
+            {
+                return error_count;
+            }
+        }
+        else if (vm.count("input-file"))
         {
             fs::path filein = quickbook::detail::input_to_path(
                 vm["input-file"].as<input_string>());
@@ -485,6 +1012,13 @@ main(int argc, char* argv[])
                     quickbook::dependency_tracker::flags(flags);
             }
 
+            if (vm.count("trace-out"))
+            {
+                parse_document_options.trace_out =
+                    quickbook::detail::input_to_path(
+                        vm["trace-out"].as<input_string>());
+            }
+
             if (vm.count("output-checked-locations"))
             {
                 parse_document_options.locations_out =
@@ -528,12 +1062,14 @@ main(int argc, char* argv[])
 
             if (vm.count("image-location"))
             {
-                quickbook::image_location = quickbook::detail::input_to_path(
-                    vm["image-location"].as<input_string>());
+                parse_document_options.image_location =
+                    quickbook::detail::input_to_path(
+                        vm["image-location"].as<input_string>());
             }
             else
             {
-                quickbook::image_location = filein.parent_path() / "html";
+                parse_document_options.image_location =
+                    filein.parent_path() / "html";
             }
 
             if (!fileout.empty()) {
@@ -542,6 +1078,15 @@ main(int argc, char* argv[])
                     << std::endl;
             }
 
+#if QUICKBOOK_WATCH
+            if (vm.count("watch"))
+            {
+                return error_count ? error_count :
+                    quickbook::watch_document(
+                        filein, fileout, parse_document_options);
+            }
+#endif
+
             if (!error_count)
                 error_count += quickbook::parse_document(
                         filein, fileout, parse_document_options);
@@ -567,6 +1112,225 @@ main(int argc, char* argv[])
         }        
     }
 
+#if QUICKBOOK_SERVER
+    // Compile a command line sent to the server.
+    static int
+    run_command_line(
+        std::vector<std::string> const& args
+      , po::options_description const& all
+      , po::positional_options_description const& p
+      , po::options_description const& desc)
+    {
+        po::variables_map vm;
+        po::store(po::command_line_parser(args)
+                .options(all)
+                .positional(p)
+                .run(), vm);
+        po::notify(vm);
+
+        if (vm.count("server") || vm.count("client") || vm.count("watch")) {
+            detail::outerr() << "Can't use --server, --client or --watch "
+                "in a server request." << std::endl;
+            return 1;
+        }
+
+        return process_options(vm, desc);
+    }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//  Main program
+//
+///////////////////////////////////////////////////////////////////////////
+int
+main(int argc, char* argv[])
+{
+    try
+    {
+        namespace fs = boost::filesystem;
+        namespace po = boost::program_options;
+
+        using boost::program_options::options_description;
+        using boost::program_options::variables_map;
+        using boost::program_options::store;
+        using boost::program_options::parse_command_line;
+        using boost::program_options::wcommand_line_parser;
+        using boost::program_options::command_line_parser;
+        using boost::program_options::notify;
+        using boost::program_options::positional_options_description;
+        
+        using quickbook::detail::input_string;
+
+        // First thing, the filesystem should record the current working directory.
+        fs::initial_path<fs::path>();
+        
+        // Various initialisation methods
+        quickbook::detail::initialise_output();
+        quickbook::detail::initialise_markups();
+
+        // Declare the program options
+
+        options_description desc("Allowed options");
+        options_description hidden("Hidden options");
+        options_description all("All options");
+
+#if QUICKBOOK_WIDE_PATHS
+#define PO_VALUE po::wvalue
+#else
+#define PO_VALUE po::value
+#endif
+
+        desc.add_options()
+            ("help", "produce help message")
+            ("version", "print version string")
+            ("no-pretty-print", "disable XML pretty printing")
+            ("timings", "report the time spent in each phase of the build")
+            ("template-stats", "report the number of calls, time taken and "
+                "output of each template")
+            ("trace-out", PO_VALUE<input_string>(),
+                "write a timeline of includes, template calls and code "
+                "blocks in the Chrome trace event format")
+            ("no-self-linked-headers", "stop headers linking to themselves")
+            ("prefetch", "load included and imported files in the "
+                "background, while the document is parsed")
+            ("memoize-elements", "remember where elements failed to parse, "
+                "so that badly nested elements aren't parsed repeatedly")
+            ("file-cache-size", PO_VALUE<int>(),
+                "megabytes of loaded files to keep cached, when they're not "
+                "in use (default: 256)")
+            ("file-cache-stats", "report the file cache's hits, misses, "
+                "size and evictions")
+            ("cache-dir", PO_VALUE<input_string>(), "keep parsed code "
+                "snippets and the output of included files in this "
+                "directory, so that other processes can reuse them")
+            ("indent", PO_VALUE<int>(), "indent spaces")
+            ("linewidth", PO_VALUE<int>(), "line width")
+            ("input-file", PO_VALUE<input_string>(), "input file")
+            ("output-file", PO_VALUE<input_string>(), "output file")
+            ("output-deps", PO_VALUE<input_string>(), "output dependency file")
+            ("debug", "debug mode (for developers)")
+            ("ms-errors", "use Microsoft Visual Studio style error & warn message format")
+            ("include-path,I", PO_VALUE< std::vector<input_string> >(), "include path")
+            ("define,D", PO_VALUE< std::vector<input_string> >(), "define macro")
+            ("image-location", PO_VALUE<input_string>(), "image location")
+            ("batch", PO_VALUE<input_string>(),
+                "compile every document listed in a batch file, one per line "
+                "as: input-file [output-file]")
+            ("jobs,j", PO_VALUE<int>(),
+                "number of documents to compile in parallel in batch mode, "
+                "0 to use all cores")
+#if QUICKBOOK_SERVER
+            ("server", PO_VALUE<input_string>(),
+                "run a compile server, listening on the given socket")
+            ("client", PO_VALUE<input_string>(),
+                "send the command line to the compile server listening on "
+                "the given socket")
+            ("stop-server", "with --client, stop the server")
+#endif
+#if QUICKBOOK_WATCH
+            ("watch", "rebuild the input file whenever one of its "
+                "dependencies changes")
+#endif
+        ;
+
+        hidden.add_options()
+            ("expect-errors",
+                "Succeed if the input file contains a correctly handled "
+                "error, fail otherwise.")
+            ("xinclude-base", PO_VALUE<input_string>(),
+                "Generate xincludes as if generating for this target "
+                "directory.")
+            ("output-deps-format", PO_VALUE<input_string>(),
+             "Comma separated list of formatting options for output-deps, "
+             "options are: escaped, checked")
+            ("output-checked-locations", PO_VALUE<input_string>(),
+             "Writes a file listing all the file locations that were "
+             "checked, starting with '+' if they were found, or '-' "
+             "if they weren't.\n"
+             "This is deprecated, use 'output-deps-format=checked' to "
+             "write the deps file in this format.")
+        ;
+
+        all.add(desc).add(hidden);
+
+        positional_options_description p;
+        p.add("input-file", -1);
+
+        // Read option from the command line
+
+        variables_map vm;
+
+#if QUICKBOOK_WIDE_PATHS
+        quickbook::ignore_variable(&argc);
+        quickbook::ignore_variable(&argv);
+
+        int wide_argc;
+        LPWSTR* wide_argv = CommandLineToArgvW(GetCommandLineW(), &wide_argc);
+        if (!wide_argv)
+        {
+            quickbook::detail::outerr() << "Error getting argument values." << std::endl;
+            return 1;
+        }
+
+        store(
+            wcommand_line_parser(wide_argc, wide_argv)
+                .options(all)
+                .positional(p)
+                .run(), vm);
+
+        LocalFree(wide_argv);
+#else
+        po::parsed_options parsed = command_line_parser(argc, argv)
+                .options(all)
+                .positional(p)
+                .run();
+        store(parsed, vm);
+#endif
+
+        notify(vm);
+
+        // Run a compile server, or pass the command line on to one.
+
+#if QUICKBOOK_SERVER
+        if (vm.count("server"))
+        {
+            return quickbook::run_server(
+                quickbook::detail::input_to_path(
+                    vm["server"].as<input_string>()),
+                boost::bind(&quickbook::run_command_line, _1,
+                    boost::cref(all), boost::cref(p), boost::cref(desc)));
+        }
+
+        if (vm.count("client"))
+        {
+            // Send the original arguments, apart from the client option.
+            std::vector<std::string> args;
+
+            if (vm.count("stop-server")) {
+                args.push_back(quickbook::stop_server_command);
+            }
+            else {
+                BOOST_FOREACH(po::option const& o, parsed.options) {
+                    if (o.string_key != "client") {
+                        args.insert(args.end(),
+                            o.original_tokens.begin(),
+                            o.original_tokens.end());
+                    }
+                }
+            }
+
+            return quickbook::run_client(
+                quickbook::detail::input_to_path(
+                    vm["client"].as<input_string>()),
+                args);
+        }
+#endif
+
+        return quickbook::process_options(vm, desc);
+    }
+
     catch(std::exception& e)
     {
         quickbook::detail::outerr() << e.what() << "\n";
@@ -27,9 +27,9 @@ namespace quickbook
     extern tm* current_gm_time; // the current UTC time
     extern bool debug_mode;
     extern bool self_linked_headers;
+    extern bool memoize_elements;
     extern std::vector<fs::path> include_path;
     extern std::vector<std::string> preset_defines;
-    extern fs::path image_location;
 
     void parse_file(quickbook::state& state,
             value include_doc_id = value(),
@@ -0,0 +1,221 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "rule_profile.hpp"
+
+#if defined(QUICKBOOK_PROFILE_RULES)
+
+#include <boost/shared_ptr.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <map>
+#include <vector>
+
+namespace quickbook
+{
+    namespace
+    {
+        struct rule_counters
+        {
+            rule_counters()
+                : calls(0), matches(0), consumed(0), rescanned(0), time(0) {}
+
+            boost::uintmax_t calls;
+            boost::uintmax_t matches;
+            boost::uintmax_t consumed;  // Bytes matched by successful calls.
+            boost::uintmax_t rescanned; // Bytes examined by failed calls,
+                                        // which will be parsed again.
+            boost::chrono::nanoseconds time;    // Including nested rules.
+        };
+
+        typedef boost::shared_ptr<rule_counters> counters_ptr;
+        typedef std::map<std::string, rule_counters> totals_map;
+
+        bool slower(totals_map::value_type const* x,
+                totals_map::value_type const* y)
+        {
+            return x->second.time > y->second.time;
+        }
+
+        // Every rule's counters, for every grammar that was created. A
+        // grammar is only used by one thread, so the counters aren't
+        // locked, they're only added up when quickbook exits.
+        struct rule_registry
+        {
+            boost::mutex mutex;
+            std::vector<std::pair<std::string, counters_ptr> > counters;
+
+            ~rule_registry() { write_report(); }
+
+            void write_report()
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if (counters.empty()) return;
+
+                totals_map totals;
+
+                for (std::size_t i = 0; i < counters.size(); ++i) {
+                    rule_counters const& c = *counters[i].second;
+                    rule_counters& t = totals[counters[i].first];
+                    t.calls += c.calls;
+                    t.matches += c.matches;
+                    t.consumed += c.consumed;
+                    t.rescanned += c.rescanned;
+                    t.time += c.time;
+                }
+
+                std::vector<totals_map::value_type const*> sorted;
+                BOOST_FOREACH(totals_map::value_type const& x, totals)
+                    sorted.push_back(&x);
+                std::sort(sorted.begin(), sorted.end(), slower);
+
+                std::ostringstream report;
+
+                report << "Rule profile, slowest first "
+                    << "(times include the rules they call):\n"
+                    << "  " << std::setw(12) << "calls"
+                    << std::setw(12) << "matches"
+                    << std::setw(14) << "bytes"
+                    << std::setw(14) << "rescanned"
+                    << std::setw(12) << "total ms"
+                    << "  rule\n";
+
+                BOOST_FOREACH(totals_map::value_type const* x, sorted)
+                {
+                    rule_counters const& t = x->second;
+
+                    report << "  " << std::setw(12) << t.calls
+                        << std::setw(12) << t.matches
+                        << std::setw(14) << t.consumed
+                        << std::setw(14) << t.rescanned
+                        << std::fixed << std::setprecision(2)
+                        << std::setw(12) << t.time.count() / 1e6
+                        << "  " << x->first << "\n";
+                }
+
+                std::cerr << report.str() << std::flush;
+            }
+        } registry;
+    }
+
+    struct rule_profiler::profiled_rule
+    {
+        // 'copy' clones the rule's definition, rather than referring to
+        // the rule, which is about to be replaced.
+        profiled_rule(rule_profiler& profiler, cl::rule<scanner> const& r)
+            : profiler(profiler), original(r.copy()),
+              counters(new rule_counters()), depth(0) {}
+
+        rule_profiler& profiler;
+        cl::rule<scanner> original;
+        counters_ptr counters;
+        int depth;  // Recursive calls aren't timed, as their time is
+                    // already included in the outer call.
+    };
+
+    namespace
+    {
+        // Restores the profiler's position when a rule finishes, or if
+        // it throws.
+        struct profiled_call
+        {
+            profiled_call(rule_profiler::profiled_rule& r,
+                    string_iterator first, string_iterator last)
+                : rule(r),
+                  last(last),
+                  outer_furthest(r.profiler.furthest),
+                  outer_last(r.profiler.last)
+            {
+                ++rule.depth;
+                rule.profiler.furthest = first;
+                rule.profiler.last = last;
+            }
+
+            ~profiled_call()
+            {
+                string_iterator furthest = rule.profiler.furthest;
+                --rule.depth;
+                rule.profiler.furthest = outer_furthest;
+                rule.profiler.last = outer_last;
+
+                // Only pass the position on if the outer rule is parsing
+                // the same text.
+                if (rule.profiler.last == last &&
+                        furthest > rule.profiler.furthest)
+                    rule.profiler.furthest = furthest;
+            }
+
+            rule_profiler::profiled_rule& rule;
+            string_iterator last;
+            string_iterator outer_furthest;
+            string_iterator outer_last;
+        };
+
+        struct profile_parser : cl::parser<profile_parser>
+        {
+            explicit profile_parser(rule_profiler::profiled_rule& r)
+                : rule(&r) {}
+
+            cl::match<> parse(scanner const& scan) const
+            {
+                rule_counters& c = *rule->counters;
+                string_iterator first = scan.first.base();
+                bool timed = !rule->depth;
+                boost::chrono::steady_clock::time_point start;
+
+                profiled_call call(*rule, first, scan.last.base());
+
+                if (timed) start = boost::chrono::steady_clock::now();
+                cl::match<> hit = rule->original.parse(scan);
+                if (timed) c.time += boost::chrono::steady_clock::now() - start;
+
+                string_iterator end = scan.first.base();
+                if (end > rule->profiler.furthest)
+                    rule->profiler.furthest = end;
+
+                ++c.calls;
+                if (hit) {
+                    ++c.matches;
+                    c.consumed += end - first;
+                }
+                else {
+                    c.rescanned += rule->profiler.furthest - first;
+                }
+
+                return hit;
+            }
+
+            rule_profiler::profiled_rule* rule;
+        };
+    }
+
+    rule_profiler::rule_profiler()
+        : furthest(), last(), rules_() {}
+
+    rule_profiler::~rule_profiler() {}
+
+    void rule_profiler::add(cl::rule<scanner>& r, char const* name)
+    {
+        rules_.push_back(new profiled_rule(*this, r));
+        r = profile_parser(rules_.back());
+
+        boost::lock_guard<boost::mutex> lock(registry.mutex);
+        registry.counters.push_back(
+            std::make_pair(std::string(name), rules_.back().counters));
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_RULE_PROFILE_HPP)
+#define BOOST_QUICKBOOK_RULE_PROFILE_HPP
+
+// When quickbook is built with QUICKBOOK_PROFILE_RULES defined, the named
+// rules in the grammar are wrapped with counters, and when quickbook exits
+// it writes a table of them to stderr, slowest first. This slows down
+// parsing, so it's only for finding which rules are expensive.
+
+#if defined(QUICKBOOK_PROFILE_RULES)
+
+#include <boost/spirit/include/classic_core.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include "grammar.hpp"
+
+namespace quickbook
+{
+    namespace cl = boost::spirit::classic;
+
+    struct rule_profiler
+    {
+        struct profiled_rule;
+
+        rule_profiler();
+        ~rule_profiler();
+
+        // Replaces the rule's definition with one which calls the original
+        // and counts it. As the definition is copied, this must be called
+        // after the rule is defined.
+        void add(cl::rule<scanner>&, char const* name);
+
+        // The furthest position reached by the innermost rule being parsed,
+        // and the end of the text it's parsing, so that nested parses of
+        // other text, e.g. for templates, aren't compared with it.
+        string_iterator furthest;
+        string_iterator last;
+
+    private:
+        rule_profiler(rule_profiler const&);
+        rule_profiler& operator=(rule_profiler const&);
+
+        boost::ptr_vector<profiled_rule> rules_;
+    };
+}
+
+#endif
+
+#endif
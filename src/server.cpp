@@ -0,0 +1,343 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "server.hpp"
+
+#if QUICKBOOK_SERVER
+
+#include "files.hpp"
+#include "input_path.hpp"
+#include "stat_cache.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace quickbook
+{
+    char const* const stop_server_command = "--stop-server";
+
+    namespace
+    {
+        // The protocol is very simple. The client sends the number of
+        // strings, followed by the strings: the working directory and then
+        // the arguments. The server replies with the captured output, the
+        // captured errors and the exit code. Numbers are 32 bit big endian,
+        // strings are a length followed by the UTF-8 bytes.
+
+        // Limits on a request, so that a bad message can't make the server
+        // allocate huge amounts of memory.
+        boost::uint32_t const max_request_strings = 1024;
+        boost::uint32_t const max_request_string_length = 1024 * 1024;
+
+        // How long the server waits for a client before giving up on it,
+        // so that a stalled client doesn't block everyone else.
+        int const client_timeout_seconds = 30;
+
+        struct socket_handle
+        {
+            int fd;
+
+            explicit socket_handle(int fd) : fd(fd) {}
+            ~socket_handle() { if (fd >= 0) ::close(fd); }
+
+        private:
+            socket_handle(socket_handle const&);
+            socket_handle& operator=(socket_handle const&);
+        };
+
+        bool write_bytes(int fd, char const* data, std::size_t length)
+        {
+            while (length) {
+                ssize_t n = ::write(fd, data, length);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                data += n;
+                length -= n;
+            }
+            return true;
+        }
+
+        bool read_bytes(int fd, char* data, std::size_t length)
+        {
+            while (length) {
+                ssize_t n = ::read(fd, data, length);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                data += n;
+                length -= n;
+            }
+            return true;
+        }
+
+        bool write_number(int fd, boost::uint32_t x)
+        {
+            char buffer[4] = {
+                static_cast<char>((x >> 24) & 0xff),
+                static_cast<char>((x >> 16) & 0xff),
+                static_cast<char>((x >> 8) & 0xff),
+                static_cast<char>(x & 0xff)
+            };
+            return write_bytes(fd, buffer, 4);
+        }
+
+        bool read_number(int fd, boost::uint32_t& x)
+        {
+            unsigned char buffer[4];
+            if (!read_bytes(fd, reinterpret_cast<char*>(buffer), 4))
+                return false;
+            x = (boost::uint32_t(buffer[0]) << 24) |
+                (boost::uint32_t(buffer[1]) << 16) |
+                (boost::uint32_t(buffer[2]) << 8) |
+                boost::uint32_t(buffer[3]);
+            return true;
+        }
+
+        bool write_string(int fd, std::string const& x)
+        {
+            return write_number(fd, static_cast<boost::uint32_t>(x.size())) &&
+                write_bytes(fd, x.data(), x.size());
+        }
+
+        bool read_string(int fd, std::string& x,
+                boost::uint32_t max_length = 0xffffffffu)
+        {
+            boost::uint32_t length;
+            if (!read_number(fd, length) || length > max_length) return false;
+            x.resize(length);
+            return !length || read_bytes(fd, &x[0], length);
+        }
+
+        bool socket_address(fs::path const& socket_path, sockaddr_un& addr)
+        {
+            std::string path = socket_path.native();
+
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path)) {
+                detail::outerr() << "Socket path too long: "
+                    << socket_path << std::endl;
+                return false;
+            }
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        int connect_to(sockaddr_un const& addr)
+        {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return -1;
+            if (::connect(fd, reinterpret_cast<sockaddr const*>(&addr),
+                    sizeof(addr)) < 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        bool set_timeouts(int fd)
+        {
+            timeval timeout;
+            timeout.tv_sec = client_timeout_seconds;
+            timeout.tv_usec = 0;
+
+            return ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+                    &timeout, sizeof(timeout)) == 0 &&
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+                    &timeout, sizeof(timeout)) == 0;
+        }
+
+        int run_request(std::vector<std::string> const& request,
+                server_command const& command,
+                std::string& output, std::string& errors)
+        {
+            fs::path server_directory = fs::current_path();
+            std::vector<std::string> args(request.begin() + 1, request.end());
+            int result = 1;
+
+            // Pick up any changes made since the last build.
+            check_loaded_files();
+            clear_stat_cache();
+
+            detail::output_capture capture;
+            capture.start();
+
+            boost::system::error_code ec;
+            fs::current_path(request[0], ec);
+
+            if (ec) {
+                detail::outerr() << "Unable to change to directory: "
+                    << request[0] << std::endl;
+            }
+            else {
+                try {
+                    result = command(args);
+                }
+                catch (std::exception& e) {
+                    detail::outerr() << e.what() << "\n";
+                }
+            }
+
+            capture.stop();
+            fs::current_path(server_directory, ec);
+
+            output = capture.output();
+            errors = capture.errors();
+            return result;
+        }
+
+        // Reads a request from a client, and runs it. Returns false if the
+        // server should stop.
+        bool handle_client(int fd, server_command const& command)
+        {
+            boost::uint32_t count;
+            std::vector<std::string> request;
+
+            if (!set_timeouts(fd) || !read_number(fd, count) ||
+                    count == 0 || count > max_request_strings)
+                return true;
+
+            request.resize(count);
+            bool valid = true;
+            for (boost::uint32_t i = 0; valid && i < count; ++i)
+                valid = read_string(fd, request[i], max_request_string_length);
+            if (!valid) return true;
+
+            std::string output, errors;
+            int result = 0;
+            bool running = true;
+
+            if (request.size() == 2 && request[1] == stop_server_command) {
+                running = false;
+            }
+            else {
+                result = run_request(request, command, output, errors);
+            }
+
+            write_string(fd, output) &&
+                write_string(fd, errors) &&
+                write_number(fd, static_cast<boost::uint32_t>(result));
+
+            return running;
+        }
+    }
+
+    int run_server(fs::path const& socket_path, server_command const& command)
+    {
+        sockaddr_un addr;
+        if (!socket_address(socket_path, addr)) return 1;
+
+        // Remove a socket left behind by a server that didn't shut down
+        // cleanly, but not one that's still in use.
+        {
+            socket_handle existing(connect_to(addr));
+            if (existing.fd >= 0) {
+                detail::outerr() << "Server already running on: "
+                    << socket_path << std::endl;
+                return 1;
+            }
+            ::unlink(addr.sun_path);
+        }
+
+        // Files will be edited while they're loaded.
+        use_memory_mapped_files(false);
+
+        socket_handle listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+
+        if (listener.fd < 0 ||
+            ::bind(listener.fd, reinterpret_cast<sockaddr const*>(&addr),
+                sizeof(addr)) < 0 ||
+            ::listen(listener.fd, 16) < 0)
+        {
+            detail::outerr() << "Unable to listen on socket " << socket_path
+                << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        // A client that disconnects early shouldn't stop the server.
+        std::signal(SIGPIPE, SIG_IGN);
+
+        detail::out() << "Listening on " << socket_path << std::endl;
+
+        bool running = true;
+
+        while (running) {
+            socket_handle client(::accept(listener.fd, 0, 0));
+
+            if (client.fd < 0) {
+                if (errno == EINTR) continue;
+                detail::outerr() << "Error accepting connection: "
+                    << std::strerror(errno) << std::endl;
+                break;
+            }
+
+            // A failure only drops this client, the server carries on.
+            try {
+                running = handle_client(client.fd, command);
+            }
+            catch (std::exception& e) {
+                detail::outerr() << "Error handling request: "
+                    << e.what() << std::endl;
+            }
+        }
+
+        ::unlink(addr.sun_path);
+        return 0;
+    }
+
+    int run_client(fs::path const& socket_path,
+            std::vector<std::string> const& args)
+    {
+        sockaddr_un addr;
+        if (!socket_address(socket_path, addr)) return 1;
+
+        socket_handle server(connect_to(addr));
+
+        if (server.fd < 0) {
+            detail::outerr() << "Unable to connect to server " << socket_path
+                << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        bool success = write_number(server.fd,
+                static_cast<boost::uint32_t>(args.size() + 1)) &&
+            write_string(server.fd, fs::current_path().native());
+
+        for (std::vector<std::string>::const_iterator it = args.begin();
+                success && it != args.end(); ++it)
+        {
+            success = write_string(server.fd, *it);
+        }
+
+        std::string output, errors;
+        boost::uint32_t result;
+
+        if (!success ||
+            !read_string(server.fd, output) ||
+            !read_string(server.fd, errors) ||
+            !read_number(server.fd, result))
+        {
+            detail::outerr() << "Lost connection to server." << std::endl;
+            return 1;
+        }
+
+        std::cout << output << std::flush;
+        std::cerr << errors << std::flush;
+        return static_cast<int>(result);
+    }
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_SERVER_HPP)
+#define BOOST_QUICKBOOK_SERVER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/filesystem/path.hpp>
+
+// A compile server keeps running between builds, so that loaded files and
+// snippets can be reused. It listens on a unix domain socket, so it's only
+// available on POSIX systems.
+
+#if !defined(_WIN32)
+#   define QUICKBOOK_SERVER 1
+#else
+#   define QUICKBOOK_SERVER 0
+#endif
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+#if QUICKBOOK_SERVER
+    // Compiles a command line. Called from the request's working directory,
+    // with its output captured.
+    typedef boost::function<int(std::vector<std::string> const&)>
+        server_command;
+
+    // Run a server on 'socket_path' until a client stops it. Returns the
+    // exit code for the server process.
+    int run_server(fs::path const& socket_path, server_command const&);
+
+    // Send a command line to the server, and write out the reply. Returns
+    // the exit code from the server's compile.
+    int run_client(fs::path const& socket_path,
+            std::vector<std::string> const& args);
+
+    // Command line that tells the server to shut down.
+    extern char const* const stop_server_command;
+#endif
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "stat_cache.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace quickbook
+{
+    namespace
+    {
+        typedef fs::path::string_type name_type;
+
+        // The names in a directory, in lower case. If the directory
+        // couldn't be read, 'valid' is false and every lookup makes a
+        // system call.
+        struct directory_listing
+        {
+            directory_listing() : valid(false), names() {}
+
+            bool valid;
+            boost::unordered_set<name_type> names;
+        };
+
+        typedef boost::shared_ptr<directory_listing const> listing_ptr;
+
+        boost::unordered_map<fs::path, fs::file_status> statuses;
+        boost::unordered_map<fs::path, listing_ptr> listings;
+        boost::unordered_map<fs::path, fs::path> canonical_paths;
+        stat_cache_stats stats;
+        boost::mutex stat_cache_mutex;
+
+        // Only ASCII, as case folding in general depends on the file
+        // system. So a name with other characters is always checked with
+        // a system call, see 'is_ascii'.
+        name_type to_lower(name_type x)
+        {
+            for (name_type::iterator it = x.begin(); it != x.end(); ++it)
+                if (*it >= 'A' && *it <= 'Z') *it = *it - 'A' + 'a';
+            return x;
+        }
+
+        bool is_ascii(name_type const& x)
+        {
+            for (name_type::const_iterator it = x.begin(); it != x.end(); ++it)
+                if (static_cast<unsigned long>(*it) > 127) return false;
+            return true;
+        }
+
+        listing_ptr list_directory(fs::path const& dir)
+        {
+            boost::shared_ptr<directory_listing> listing(
+                new directory_listing);
+            boost::system::error_code ec;
+            fs::directory_iterator it(dir, ec), end;
+
+            while (!ec && it != end) {
+                listing->names.insert(
+                    to_lower(it->path().filename().native()));
+                it.increment(ec);
+            }
+
+            // A directory which doesn't exist has no files.
+            listing->valid = !ec ||
+                ec == boost::system::errc::no_such_file_or_directory;
+            return listing;
+        }
+    }
+
+    fs::file_status cached_status(fs::path const& p)
+    {
+        fs::path dir = p.parent_path();
+        fs::path name = p.filename();
+        if (dir.empty()) dir = ".";
+
+        listing_ptr listing;
+
+        {
+            boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+            ++stats.lookups;
+
+            boost::unordered_map<fs::path, fs::file_status>::const_iterator
+                pos = statuses.find(p);
+            if (pos != statuses.end()) {
+                ++stats.saved;
+                return pos->second;
+            }
+
+            boost::unordered_map<fs::path, listing_ptr>::const_iterator
+                listing_pos = listings.find(dir);
+            if (listing_pos != listings.end()) listing = listing_pos->second;
+        }
+
+        // "." and ".." aren't in directory listings.
+        bool use_listing = name != "." && name != ".." && !name.empty() &&
+            is_ascii(name.native());
+
+        if (use_listing && listing && listing->valid &&
+                !listing->names.count(to_lower(name.native())))
+        {
+            boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+            ++stats.saved;
+            return statuses.emplace(p,
+                fs::file_status(fs::file_not_found)).first->second;
+        }
+
+        boost::system::error_code ec;
+        fs::file_status status = fs::status(p, ec);
+
+        // A directory is only listed once a file in it is found to be
+        // missing, as that's when it's likely to be searched for others.
+        listing_ptr new_listing;
+        if (use_listing && !listing && !fs::exists(status))
+            new_listing = list_directory(dir);
+
+        boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+        ++stats.system_calls;
+        if (new_listing) {
+            ++stats.system_calls;
+            listings.emplace(dir, new_listing);
+        }
+        return statuses.emplace(p, status).first->second;
+    }
+
+    fs::path cached_canonical(fs::path const& p)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+            ++stats.lookups;
+
+            boost::unordered_map<fs::path, fs::path>::const_iterator
+                pos = canonical_paths.find(p);
+            if (pos != canonical_paths.end()) {
+                ++stats.saved;
+                return pos->second;
+            }
+        }
+
+        // Throws if the path doesn't exist, as fs::canonical does.
+        fs::path result = fs::canonical(p);
+
+        boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+        ++stats.system_calls;
+        return canonical_paths.emplace(p, result).first->second;
+    }
+
+    void clear_stat_cache()
+    {
+        boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+        statuses.clear();
+        listings.clear();
+        canonical_paths.clear();
+    }
+
+    stat_cache_stats get_stat_cache_stats()
+    {
+        boost::lock_guard<boost::mutex> lock(stat_cache_mutex);
+        return stats;
+    }
+}
@@ -0,0 +1,59 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_STAT_CACHE_HPP)
+#define BOOST_QUICKBOOK_STAT_CACHE_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/cstdint.hpp>
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // Caches file system lookups for the whole process, as include paths
+    // mean that the same files and directories are checked many times.
+    //
+    // When a file isn't found, its directory is listed, so that looking
+    // for other missing files in that directory, as happens when searching
+    // the include path, doesn't need another system call. Names are
+    // compared ignoring case, so that this works on case insensitive file
+    // systems.
+    fs::file_status cached_status(fs::path const&);
+
+    inline bool cached_exists(fs::path const& p)
+    {
+        return fs::exists(cached_status(p));
+    }
+
+    inline bool cached_is_regular_file(fs::path const& p)
+    {
+        return fs::is_regular_file(cached_status(p));
+    }
+
+    // fs::canonical, for a path that exists.
+    fs::path cached_canonical(fs::path const&);
+
+    // For long running processes: forget everything, as files might have
+    // been added or removed.
+    void clear_stat_cache();
+
+    struct stat_cache_stats
+    {
+        stat_cache_stats() : lookups(0), system_calls(0), saved(0) {}
+
+        boost::uintmax_t lookups;
+        boost::uintmax_t system_calls;  // Including directory listings.
+        boost::uintmax_t saved;         // Lookups answered from the cache.
+    };
+
+    stat_cache_stats get_stat_cache_stats();
+}
+
+#endif
@@ -24,27 +24,34 @@ namespace quickbook
     char const* quickbook_get_date = "__quickbook_get_date__";
     char const* quickbook_get_time = "__quickbook_get_time__";
 
-    unsigned qbk_version_n = 0; // qbk_major_version * 100 + qbk_minor_version
+    // qbk_major_version * 100 + qbk_minor_version
+    QUICKBOOK_THREAD_LOCAL unsigned qbk_version_n = 0;
 
     state::state(fs::path const& filein_, fs::path const& xinclude_base_,
             string_stream& out_, id_manager& ids)
         : grammar_()
 
         , xinclude_base(xinclude_base_)
+        , image_location()
 
         , templates()
         , error_count(0)
         , anchors()
         , warned_about_breaks(false)
         , conditional(true)
-        , ids(ids)
+        , ids(&ids)
         , callouts()
         , callout_depth(0)
         , dependencies()
+        , phase_timings(0)
+        , tracer(0)
+        , template_statistics(0)
+        , recording(0)
         , explicit_list(false)
 
         , imported(false)
         , macro()
+        , macro_definitions()
         , source_mode("c++")
         , source_mode_next()
         , current_file(0)
@@ -60,17 +67,74 @@ namespace quickbook
 
         , values(&current_file)
     {
-        // add the predefined macros
+        add_predefined_macros();
+
+        boost::scoped_ptr<quickbook_grammar> g(
+            new quickbook_grammar(*this));
+        grammar_.swap(g);
+    }
+
+    void state::reset(fs::path const& filein_,
+            fs::path const& xinclude_base_,
+            string_stream& out_, id_manager& ids_)
+    {
+        clear();
+
+        xinclude_base = xinclude_base_;
+        ids = &ids_;
+        filename_relative = filein_.filename();
+        out.reset(out_);
+
+        add_predefined_macros();
+    }
+
+    void state::clear()
+    {
+        xinclude_base = fs::path();
+        image_location = fs::path();
+
+        templates.reset();
+        error_count = 0;
+        anchors.clear();
+        warned_about_breaks = false;
+        conditional = true;
+        ids = 0;
+        value_builder().swap(callouts);
+        callout_depth = 0;
+        dependencies = dependency_tracker();
+        phase_timings = 0;
+        tracer = 0;
+        template_statistics = 0;
+        recording = 0;
+        explicit_list = false;
+
+        imported = false;
+        macro = string_symbols();
+        macro_definitions.clear();
+        source_mode = "c++";
+        source_mode_next = value();
+        current_file = 0;
+        filename_relative = fs::path();
+
+        template_depth = 0;
+        min_section_level = 1;
+        failed_elements.clear();
+
+        in_list = false;
+        in_list_save = std::stack<bool>();
+        out.reset();
+        phrase.reset();
+
+        value_builder().swap(values.builder);
+    }
+
+    void state::add_predefined_macros() {
         macro.add
             ("__DATE__", std::string(quickbook_get_date))
             ("__TIME__", std::string(quickbook_get_time))
             ("__FILENAME__", std::string())
         ;
         update_filename_macro();
-
-        boost::scoped_ptr<quickbook_grammar> g(
-            new quickbook_grammar(*this));
-        grammar_.swap(g);
     }
 
     quickbook_grammar& state::grammar() const {
@@ -105,10 +169,18 @@ namespace quickbook
         , xinclude_base(state.xinclude_base)
         , source_mode(state.source_mode)
         , macro()
+        , macro_definitions()
         , template_depth(state.template_depth)
         , min_section_level(state.min_section_level)
+        , failed_elements()
     {
-        if (scope & scope_macros) macro = state.macro;
+        // Start with no failures, as the same text can be parsed again in
+        // a different context, e.g. for each call to a template.
+        state.failed_elements.swap(failed_elements);
+        if (scope & scope_macros) {
+            macro = state.macro;
+            macro_definitions = state.macro_definitions;
+        }
         if (scope & scope_templates) state.templates.push();
         if (scope & scope_output) {
             state.push_output();
@@ -129,8 +201,12 @@ namespace quickbook
             state.pop_output();
         }
         if (scope & scope_templates) state.templates.pop();
-        if (scope & scope_macros) state.macro = macro;
+        if (scope & scope_macros) {
+            state.macro = macro;
+            state.macro_definitions.swap(macro_definitions);
+        }
         boost::swap(state.template_depth, template_depth);
         boost::swap(state.min_section_level, min_section_level);
+        state.failed_elements.swap(failed_elements);
     }
 }
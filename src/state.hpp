@@ -12,23 +12,73 @@
 
 #include <map>
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
 #include "parsers.hpp"
 #include "values_parse.hpp"
 #include "collector.hpp"
 #include "template_stack.hpp"
 #include "symbols.hpp"
 #include "dependency_tracker.hpp"
+#include "threads.hpp"
 
 namespace quickbook
 {
     namespace cl = boost::spirit::classic;
     namespace fs = boost::filesystem;
 
+    // A position where an element failed to parse, along with the parser
+    // state that can change the result. Used when 'memoize_elements' is set.
+    // The position is an offset into a file which is held, as a file
+    // created during a parse, e.g. for a code block, can be freed and its
+    // address reused by the next one.
+    struct failed_element
+    {
+        failed_element(file_ptr const& file, std::size_t offset,
+                unsigned context, bool no_eols)
+            : file(file), offset(offset), context(context), no_eols(no_eols)
+        {}
+
+        file_ptr file;
+        std::size_t offset;
+        unsigned context;
+        bool no_eols;
+
+        friend bool operator==(failed_element const& x,
+                failed_element const& y)
+        {
+            return x.file == y.file && x.offset == y.offset &&
+                x.context == y.context && x.no_eols == y.no_eols;
+        }
+
+        friend std::size_t hash_value(failed_element const& x)
+        {
+            std::size_t seed = boost::hash_value(x.file.get());
+            boost::hash_combine(seed, x.offset);
+            boost::hash_combine(seed, x.context);
+            boost::hash_combine(seed, x.no_eols);
+            return seed;
+        }
+    };
+
+    typedef boost::unordered_set<failed_element> failed_element_set;
+
     struct state
     {
         state(fs::path const& filein_, fs::path const& xinclude_base, string_stream& out_,
                 id_manager&);
 
+        // Start a new document, keeping the grammar. The grammar's rules
+        // are bound to this object and its members, so they're reset in
+        // place rather than recreated.
+        void reset(fs::path const& filein_, fs::path const& xinclude_base,
+                string_stream& out_, id_manager&);
+
+        // Finish with the current document, so that a state kept for
+        // later doesn't hold on to its files, templates and macros, or
+        // refer to the objects it was reset with.
+        void clear();
+
     private:
         boost::scoped_ptr<quickbook_grammar> grammar_;
 
@@ -43,20 +93,29 @@ namespace quickbook
 
     // global state
         fs::path                xinclude_base;
+        fs::path                image_location;
         template_stack          templates;
         int                     error_count;
         string_list             anchors;
         bool                    warned_about_breaks;
         bool                    conditional;
-        id_manager&             ids;
+        id_manager*             ids;
         value_builder           callouts;           // callouts are global as
         int                     callout_depth;      // they don't nest.
         dependency_tracker      dependencies;
+        timings*                phase_timings;      // null unless reporting
+        trace*                  tracer;             // null unless tracing
+        template_stats*         template_statistics; // null unless collecting
+        include_recording*      recording;          // null unless recording
+                                                    // an included file.
         bool                    explicit_list;      // set when using a list
 
     // state saved for files and templates.
         bool                    imported;
         string_symbols          macro;
+        std::string             macro_definitions;  // each definition added
+                                                    // to 'macro', to check
+                                                    // the include cache.
         std::string             source_mode;
         value                   source_mode_next;
         file_ptr                current_file;
@@ -67,6 +126,8 @@ namespace quickbook
     // state saved for templates.
         int                     template_depth;
         int                     min_section_level;
+        failed_element_set      failed_elements;    // elements which failed
+                                                    // in this parse.
 
     // output state - scoped by templates and grammar
         bool                    in_list;        // generating a list
@@ -84,6 +145,7 @@ namespace quickbook
     // actions
     ///////////////////////////////////////////////////////////////////////////
 
+        void add_predefined_macros();
         void update_filename_macro();
 
         void push_output();
@@ -99,7 +161,8 @@ namespace quickbook
         std::string end_callouts();
     };
 
-    extern unsigned qbk_version_n; // qbk_major_version * 100 + qbk_minor_version
+    // qbk_major_version * 100 + qbk_minor_version
+    extern QUICKBOOK_THREAD_LOCAL unsigned qbk_version_n;
     extern char const* quickbook_get_date;
     extern char const* quickbook_get_time;
 }
@@ -42,8 +42,10 @@ namespace quickbook
         fs::path xinclude_base;
         std::string source_mode;
         string_symbols macro;
+        std::string macro_definitions;
         int template_depth;
         int min_section_level;
+        failed_element_set failed_elements;
     private:
         state_save(state_save const&);
         state_save& operator=(state_save const&);
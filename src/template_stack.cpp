@@ -10,6 +10,8 @@
 #include <cassert>
 #include "template_stack.hpp"
 #include "files.hpp"
+#include "disk_cache.hpp"
+#include "input_path.hpp"
 
 #ifdef BOOST_MSVC
 #pragma warning(disable : 4355)
@@ -40,6 +42,13 @@ namespace quickbook
         scopes.push_front(template_scope());
         parent_1_4 = &scopes.front();
     }
+
+    void template_stack::reset()
+    {
+        scopes.clear();
+        scopes.push_front(template_scope());
+        parent_1_4 = &scopes.front();
+    }
     
     template_symbol* template_stack::find(std::string const& symbol) const
     {
@@ -77,8 +86,10 @@ namespace quickbook
             return false;
         }
         
-        boost::spirit::classic::add(scopes.front().symbols,
-            ts.identifier.c_str(), ts);
+        template_symbol const* added =
+            boost::spirit::classic::add(scopes.front().symbols,
+                ts.identifier.c_str(), ts);
+        if (added) scopes.front().templates.push_back(added);
 
         return true;
     }
@@ -114,6 +125,85 @@ namespace quickbook
             scopes.front().parent_scope = scopes.front().parent_1_4;
         }
     }
-}
 
+    namespace
+    {
+        // Writes the position of 'scope' in 'scopes', or the number of
+        // scopes for null. Returns false if it isn't in 'scopes'.
+        bool write_scope(std::string& out, template_stack::deque const& scopes,
+                template_scope const* scope)
+        {
+            std::size_t index = 0;
+
+            for (template_stack::deque::const_iterator it = scopes.begin();
+                    it != scopes.end() && &*it != scope; ++it)
+            {
+                ++index;
+            }
+
+            if (scope && index == scopes.size()) return false;
+
+            write_cache_int(out, index);
+            return true;
+        }
+    }
+
+    bool template_stack::describe(std::string& out) const
+    {
+        if (!write_scope(out, scopes, parent_1_4)) return false;
+        write_cache_int(out, scopes.size());
 
+        for (deque::const_iterator it = scopes.begin(); it != scopes.end(); ++it)
+        {
+            if (!write_scope(out, scopes, it->parent_scope) ||
+                    !write_scope(out, scopes, it->parent_1_4))
+                return false;
+
+            write_cache_int(out, it->templates.size());
+
+            for (std::vector<template_symbol const*>::const_iterator
+                    t = it->templates.begin(); t != it->templates.end(); ++t)
+            {
+                template_symbol const& symbol = **t;
+
+                write_cache_string(out, symbol.identifier);
+                write_cache_int(out, symbol.params.size());
+                for (std::vector<std::string>::const_iterator
+                        p = symbol.params.begin(); p != symbol.params.end(); ++p)
+                {
+                    write_cache_string(out, *p);
+                }
+
+                if (!write_scope(out, scopes, symbol.lexical_parent))
+                    return false;
+
+                value const& content = symbol.content;
+                write_cache_int(out, content.get_tag());
+                write_cache_int(out, content.is_encoded());
+                if (content.is_encoded())
+                    write_cache_string(out, content.get_encoded());
+
+                // Encoded templates might not have a source.
+                file_ptr f;
+                boost::string_ref source;
+
+                try {
+                    f = content.get_file();
+                    source = content.get_quickbook();
+                }
+                catch (value_error&) {
+                    f = 0;
+                }
+
+                write_cache_int(out, f ? 1 : 0);
+                if (f) {
+                    write_cache_string(out, source);
+                    write_cache_string(out, detail::path_to_generic(f->path));
+                    write_cache_int(out, f->version());
+                }
+            }
+        }
+
+        return true;
+    }
+}
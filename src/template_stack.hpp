@@ -64,6 +64,9 @@ namespace quickbook
         template_scope const* parent_scope;
         template_scope const* parent_1_4;
         template_symbols symbols;
+
+        // The templates in 'symbols', in the order they were added.
+        std::vector<template_symbol const*> templates;
     };
 
     struct template_stack
@@ -100,6 +103,8 @@ namespace quickbook
         };
 
         template_stack();
+        // Remove all templates, leaving just the top level scope.
+        void reset();
         template_symbol* find(std::string const& symbol) const;
         template_symbol* find_top_scope(std::string const& symbol) const;
         template_symbols const& top() const;
@@ -112,6 +117,12 @@ namespace quickbook
 
         void start_template(template_symbol const*);
 
+        // Writes a description of the templates and scopes to 'out'.
+        // Templates are found in the same way for two equal descriptions,
+        // so this is used to check the environment for the include cache.
+        // Returns false if the templates can't be described.
+        bool describe(std::string& out) const;
+
         boost::spirit::classic::functor_parser<parser> scope;
 
     private:
@@ -0,0 +1,109 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "template_stats.hpp"
+#include "template_stack.hpp"
+#include "state.hpp"
+#include "files.hpp"
+#include "input_path.hpp"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+namespace quickbook
+{
+    namespace
+    {
+        typedef template_stats::entry_map::value_type stats_value;
+
+        bool more_expensive(stats_value const* x, stats_value const* y)
+        {
+            return x->second.self > y->second.self;
+        }
+
+        // The size of the output, to work out how much a template
+        // generates. Older templates swap out the output while they're
+        // expanded, so this is only checked before and after.
+        boost::uintmax_t output_size(quickbook::state& state)
+        {
+            return state.out.str().size() + state.phrase.str().size();
+        }
+    }
+
+    void template_stats::write_report() const
+    {
+        std::vector<stats_value const*> sorted;
+        BOOST_FOREACH(stats_value const& x, entries) sorted.push_back(&x);
+        std::sort(sorted.begin(), sorted.end(), more_expensive);
+
+        std::ostringstream report;
+
+        report << "Template statistics, most expensive first:\n"
+            << "  " << std::setw(8) << "calls"
+            << std::setw(12) << "total ms"
+            << std::setw(12) << "self ms"
+            << std::setw(7) << "depth"
+            << std::setw(12) << "bytes out"
+            << "  template (file)\n";
+
+        BOOST_FOREACH(stats_value const* x, sorted)
+        {
+            entry const& e = x->second;
+
+            report << "  " << std::setw(8) << e.calls
+                << std::fixed << std::setprecision(2)
+                << std::setw(12) << e.total.count() / 1e6
+                << std::setw(12) << e.self.count() / 1e6
+                << std::setw(7) << e.max_depth
+                << std::setw(12) << e.bytes
+                << "  " << x->first.first
+                << " (" << x->first.second << ")\n";
+        }
+
+        detail::out() << report.str() << std::flush;
+    }
+
+    template_call_stats::template_call_stats(quickbook::state& state,
+            template_symbol const* symbol)
+        : state(state)
+    {
+        if (!state.template_statistics) return;
+
+        template_stats::call c;
+        c.k = template_stats::key(symbol->identifier,
+            detail::path_to_generic(symbol->content.get_file()->path));
+        c.nested = boost::chrono::nanoseconds(0);
+        c.start_bytes = output_size(state);
+        c.start = boost::chrono::steady_clock::now();
+        state.template_statistics->calls.push_back(c);
+    }
+
+    template_call_stats::~template_call_stats()
+    {
+        template_stats* stats = state.template_statistics;
+        if (!stats) return;
+
+        template_stats::call const& c = stats->calls.back();
+        boost::chrono::nanoseconds elapsed =
+            boost::chrono::steady_clock::now() - c.start;
+        boost::uintmax_t end_bytes = output_size(state);
+
+        template_stats::entry& e = stats->entries[c.k];
+        ++e.calls;
+        e.total += elapsed;
+        e.self += elapsed - c.nested;
+        // The depth is one more than the caller's, as it's incremented
+        // when the template is expanded.
+        e.max_depth = (std::max)(e.max_depth, state.template_depth + 1);
+        if (end_bytes > c.start_bytes) e.bytes += end_bytes - c.start_bytes;
+
+        stats->calls.pop_back();
+        if (!stats->calls.empty()) stats->calls.back().nested += elapsed;
+    }
+}
@@ -0,0 +1,70 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_TEMPLATE_STATS_HPP)
+#define BOOST_QUICKBOOK_TEMPLATE_STATS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include "fwd.hpp"
+
+namespace quickbook
+{
+    // Statistics for each template called while building a document, for
+    // '--template-stats'.
+    struct template_stats
+    {
+        struct entry
+        {
+            entry()
+                : calls(0), total(0), self(0), max_depth(0), bytes(0) {}
+
+            unsigned calls;
+            boost::chrono::nanoseconds total;   // Including nested calls.
+            boost::chrono::nanoseconds self;    // Excluding nested calls.
+            int max_depth;
+            boost::uintmax_t bytes;             // Output generated.
+        };
+
+        // Templates are identified by name and the file they're defined in.
+        typedef std::pair<std::string, std::string> key;
+        typedef std::map<key, entry> entry_map;
+
+        struct call
+        {
+            key k;
+            boost::chrono::steady_clock::time_point start;
+            boost::chrono::nanoseconds nested;
+            boost::uintmax_t start_bytes;
+        };
+
+        void write_report() const;
+
+        entry_map entries;
+        std::vector<call> calls;   // The calls currently being expanded.
+    };
+
+    // Records a template call, from construction to destruction. Does
+    // nothing if the state isn't collecting statistics.
+    struct template_call_stats
+    {
+        template_call_stats(quickbook::state&, template_symbol const*);
+        ~template_call_stats();
+
+    private:
+        template_call_stats(template_call_stats const&);
+        template_call_stats& operator=(template_call_stats const&);
+
+        quickbook::state& state;
+    };
+}
+
+#endif
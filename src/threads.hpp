@@ -0,0 +1,26 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_THREADS_HPP)
+#define BOOST_QUICKBOOK_THREADS_HPP
+
+#include <boost/config.hpp>
+
+// Storage for state which belongs to the compilation running on the
+// current thread, so that several documents can be compiled in parallel.
+// Only suitable for simple types that don't need dynamic initialisation.
+
+#if !defined(BOOST_NO_CXX11_THREAD_LOCAL)
+#   define QUICKBOOK_THREAD_LOCAL thread_local
+#elif defined(BOOST_MSVC)
+#   define QUICKBOOK_THREAD_LOCAL __declspec(thread)
+#else
+#   define QUICKBOOK_THREAD_LOCAL __thread
+#endif
+
+#endif
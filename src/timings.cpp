@@ -0,0 +1,173 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "timings.hpp"
+#include "input_path.hpp"
+#include "stat_cache.hpp"
+#include <boost/foreach.hpp>
+#include <sstream>
+#include <iomanip>
+
+namespace quickbook
+{
+    namespace
+    {
+        void add_times(timings::entry& e, boost::timer::cpu_times const& t)
+        {
+            e.wall += t.wall;
+            e.cpu += t.user + t.system;
+        }
+
+        void write_entry(std::ostream& out, timings::entry const& e)
+        {
+            // Throughput is measured for the input, apart from when there
+            // is only output, such as when writing the output file.
+            boost::uintmax_t bytes = e.bytes_in ? e.bytes_in : e.bytes_out;
+            double seconds = e.wall / 1e9;
+
+            out << "  " << std::left << std::setw(24) << e.name << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << e.wall / 1e6
+                << std::setw(10) << e.cpu / 1e6
+                << std::setw(12) << e.bytes_in
+                << std::setw(12) << e.bytes_out;
+
+            if (bytes && seconds > 0) {
+                out << std::setw(10) << bytes / seconds / (1024 * 1024);
+            }
+            else {
+                out << std::setw(10) << "-";
+            }
+
+            out << "\n";
+        }
+
+        void write_heading(std::ostream& out, char const* name)
+        {
+            out << "  " << std::left << std::setw(24) << name << std::right
+                << std::setw(10) << "wall ms"
+                << std::setw(10) << "cpu ms"
+                << std::setw(12) << "bytes in"
+                << std::setw(12) << "bytes out"
+                << std::setw(10) << "MB/s"
+                << "\n";
+        }
+    }
+
+    void timings::add_phase(std::string const& name,
+            boost::timer::cpu_times const& t,
+            boost::uintmax_t bytes_in, boost::uintmax_t bytes_out)
+    {
+        std::vector<entry>::iterator it = phases.begin();
+        while (it != phases.end() && it->name != name) ++it;
+        if (it == phases.end()) it = phases.insert(it, entry(name));
+
+        add_times(*it, t);
+        it->bytes_in += bytes_in;
+        it->bytes_out += bytes_out;
+    }
+
+    void timings::add_file(fs::path const& path,
+            boost::timer::cpu_times const& t, boost::uintmax_t bytes)
+    {
+        files.push_back(entry(detail::path_to_generic(path)));
+        add_times(files.back(), t);
+        files.back().bytes_in = bytes;
+    }
+
+    void timings::write_report(fs::path const& document) const
+    {
+        std::ostringstream report;
+
+        report << "Timings for " << detail::path_to_generic(document)
+            << ":\n";
+        write_heading(report, "Phase");
+        BOOST_FOREACH(entry const& e, phases) write_entry(report, e);
+
+        if (!files.empty()) {
+            report << "\n";
+            write_heading(report, "Included file");
+            BOOST_FOREACH(entry const& e, files) write_entry(report, e);
+        }
+
+        // The cache is shared by every document in the process, so this is
+        // the total so far.
+        stat_cache_stats stats = get_stat_cache_stats();
+        report << "\nFile system lookups: " << stats.lookups
+            << ", system calls: " << stats.system_calls
+            << ", saved: " << stats.saved << "\n";
+
+        detail::out() << report.str() << std::flush;
+    }
+
+    timed_phase::timed_phase(timings* t, char const* name,
+            boost::uintmax_t bytes_in)
+        : timings_(t), name(name), bytes_in(bytes_in), bytes_out(0), timer()
+    {
+    }
+
+    timed_phase::~timed_phase()
+    {
+        if (timings_) {
+            timings_->add_phase(name, timer.elapsed(), bytes_in, bytes_out);
+        }
+    }
+
+    timed_streambuf::timed_streambuf(std::streambuf* destination)
+        : destination(destination), buffer(64 * 1024), bytes_(0), timer()
+    {
+        timer.stop();
+        setp(&buffer[0], &buffer[0] + buffer.size());
+    }
+
+    timed_streambuf::~timed_streambuf()
+    {
+        write_buffer();
+    }
+
+    void timed_streambuf::discard()
+    {
+        setp(&buffer[0], &buffer[0] + buffer.size());
+    }
+
+    bool timed_streambuf::write_buffer()
+    {
+        std::streamsize n = pptr() - pbase();
+        if (!n) return true;
+
+        timer.resume();
+        std::streamsize written = destination->sputn(pbase(), n);
+        timer.stop();
+
+        bytes_ += written;
+        discard();
+        return written == n;
+    }
+
+    timed_streambuf::int_type timed_streambuf::overflow(int_type c)
+    {
+        if (!write_buffer()) return traits_type::eof();
+
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+
+        return traits_type::not_eof(c);
+    }
+
+    int timed_streambuf::sync()
+    {
+        if (!write_buffer()) return -1;
+
+        timer.resume();
+        int result = destination->pubsync();
+        timer.stop();
+        return result;
+    }
+}
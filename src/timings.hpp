@@ -0,0 +1,110 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_TIMINGS_HPP)
+#define BOOST_QUICKBOOK_TIMINGS_HPP
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <boost/cstdint.hpp>
+#include <boost/timer/timer.hpp>
+#include <boost/filesystem/path.hpp>
+#include "fwd.hpp"
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // The time spent building a document, for '--timings'. CPU time is for
+    // the whole process, so it includes other documents when compiling a
+    // batch in parallel.
+    struct timings
+    {
+        struct entry
+        {
+            entry(std::string const& name)
+                : name(name), wall(0), cpu(0), bytes_in(0), bytes_out(0) {}
+
+            std::string name;
+            boost::timer::nanosecond_type wall;
+            boost::timer::nanosecond_type cpu;
+            boost::uintmax_t bytes_in;
+            boost::uintmax_t bytes_out;
+        };
+
+        // Phases are added up by name, and reported in the order they
+        // were first added.
+        void add_phase(std::string const& name,
+                boost::timer::cpu_times const&,
+                boost::uintmax_t bytes_in, boost::uintmax_t bytes_out);
+
+        // Parse time for an included file, including any files it
+        // includes.
+        void add_file(fs::path const&, boost::timer::cpu_times const&,
+                boost::uintmax_t bytes);
+
+        void write_report(fs::path const& document) const;
+
+        std::vector<entry> phases;
+        std::vector<entry> files;
+    };
+
+    // Times a scope, and adds it to the report when it ends. Does nothing if
+    // timings is null.
+    struct timed_phase
+    {
+        timed_phase(timings*, char const* name,
+                boost::uintmax_t bytes_in = 0);
+        ~timed_phase();
+
+        void set_bytes_in(boost::uintmax_t x) { bytes_in = x; }
+        void set_bytes_out(boost::uintmax_t x) { bytes_out = x; }
+
+    private:
+        timed_phase(timed_phase const&);
+        timed_phase& operator=(timed_phase const&);
+
+        timings* timings_;
+        char const* name;
+        boost::uintmax_t bytes_in;
+        boost::uintmax_t bytes_out;
+        boost::timer::cpu_timer timer;
+    };
+
+    // Passes output through to another stream buffer, timing the writes.
+    // Output is buffered, so that the timer is only started and stopped
+    // for each block that's written, rather than each call.
+    struct timed_streambuf : std::streambuf
+    {
+        explicit timed_streambuf(std::streambuf*);
+        ~timed_streambuf();
+
+        boost::timer::cpu_times elapsed() const { return timer.elapsed(); }
+
+        // Includes output that hasn't been written yet.
+        boost::uintmax_t bytes() const { return bytes_ + (pptr() - pbase()); }
+
+        // Drops any output that hasn't been written yet.
+        void discard();
+
+    protected:
+        int_type overflow(int_type);
+        int sync();
+
+    private:
+        bool write_buffer();
+
+        std::streambuf* destination;
+        std::vector<char> buffer;
+        boost::uintmax_t bytes_;
+        boost::timer::cpu_timer timer;
+    };
+}
+
+#endif
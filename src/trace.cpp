@@ -0,0 +1,133 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "trace.hpp"
+#include "files.hpp"
+#include "input_path.hpp"
+#include <boost/lexical_cast.hpp>
+#include <stdexcept>
+#include <cstdio>
+
+namespace quickbook
+{
+    namespace
+    {
+        void write_json_string(std::ostream& out, boost::string_ref x)
+        {
+            out << '"';
+
+            for (boost::string_ref::const_iterator it = x.begin();
+                    it != x.end(); ++it)
+            {
+                unsigned char c = *it;
+
+                switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        char buffer[8];
+                        std::sprintf(buffer, "\\u%04x", c);
+                        out << buffer;
+                    }
+                    else {
+                        out << *it;
+                    }
+                }
+            }
+
+            out << '"';
+        }
+    }
+
+    trace::trace(fs::path const& filename)
+        : out(filename),
+          start(boost::chrono::steady_clock::now()),
+          first_event(true)
+    {
+        if (out.fail()) {
+            throw std::runtime_error(
+                "Error opening trace file " +
+                detail::path_to_generic(filename));
+        }
+
+        out << "{\"traceEvents\":[";
+    }
+
+    trace::~trace()
+    {
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    // Timestamps are in microseconds.
+    void trace::write_time()
+    {
+        boost::chrono::nanoseconds t =
+            boost::chrono::steady_clock::now() - start;
+
+        char buffer[32];
+        std::sprintf(buffer, "%lld.%03d",
+                static_cast<long long>(t.count() / 1000),
+                static_cast<int>(t.count() % 1000));
+        out << "\"ts\":" << buffer;
+    }
+
+    void trace::begin(char const* category, boost::string_ref name,
+            char const* arg_name, boost::string_ref arg_value)
+    {
+        out << (first_event ? "\n" : ",\n") << "{\"ph\":\"B\",\"pid\":1,\"tid\":1,";
+        first_event = false;
+        write_time();
+        out << ",\"cat\":\"" << category << "\",\"name\":";
+        write_json_string(out, name);
+
+        if (arg_name) {
+            out << ",\"args\":{\"" << arg_name << "\":";
+            write_json_string(out, arg_value);
+            out << "}";
+        }
+
+        out << "}";
+    }
+
+    void trace::end()
+    {
+        out << ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":1,";
+        write_time();
+        out << "}";
+    }
+
+    trace_span::trace_span(trace* t, char const* category,
+            boost::string_ref name,
+            char const* arg_name, boost::string_ref arg_value)
+        : trace_(t)
+    {
+        if (trace_) trace_->begin(category, name, arg_name, arg_value);
+    }
+
+    trace_span::trace_span(trace* t, char const* category,
+            boost::string_ref name,
+            file_ptr const& f, string_iterator pos)
+        : trace_(t)
+    {
+        if (trace_) {
+            file_position p = f->position_of(pos);
+            trace_->begin(category, name, "position",
+                detail::path_to_generic(f->path) + ":" +
+                boost::lexical_cast<std::string>(p.line) + ":" +
+                boost::lexical_cast<std::string>(p.column));
+        }
+    }
+
+    trace_span::~trace_span()
+    {
+        if (trace_) trace_->end();
+    }
+}
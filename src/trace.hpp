@@ -0,0 +1,68 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_TRACE_HPP)
+#define BOOST_QUICKBOOK_TRACE_HPP
+
+#include <string>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/utility/string_ref.hpp>
+#include "fwd.hpp"
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // Writes a timeline of the build for '--trace-out', in the Chrome trace
+    // event format, which can be loaded into chrome://tracing or Perfetto.
+    struct trace
+    {
+        // Throws std::runtime_error if the file can't be opened.
+        explicit trace(fs::path const&);
+        ~trace();
+
+        void begin(char const* category, boost::string_ref name,
+                char const* arg_name, boost::string_ref arg_value);
+        void end();
+
+    private:
+        trace(trace const&);
+        trace& operator=(trace const&);
+
+        void write_time();
+
+        fs::ofstream out;
+        boost::chrono::steady_clock::time_point start;
+        bool first_event;
+    };
+
+    // A span in the trace, from construction to destruction. Does nothing
+    // if the trace is null.
+    struct trace_span
+    {
+        trace_span(trace*, char const* category, boost::string_ref name,
+                char const* arg_name = 0,
+                boost::string_ref arg_value = boost::string_ref());
+
+        // Records the position in a file as 'position'. Only worked out
+        // when tracing, as it isn't cheap.
+        trace_span(trace*, char const* category, boost::string_ref name,
+                file_ptr const&, string_iterator);
+
+        ~trace_span();
+
+    private:
+        trace_span(trace_span const&);
+        trace_span& operator=(trace_span const&);
+
+        trace* trace_;
+    };
+}
+
+#endif
@@ -50,13 +50,28 @@ namespace quickbook { namespace detail
         }
     }
 
+    // Writes runs of characters which don't need escaping in one go,
+    // rather than a character at a time.
     void print_string(boost::string_ref str, std::ostream& out)
     {
+        boost::string_ref::const_iterator run = str.begin();
+
         for (boost::string_ref::const_iterator cur = str.begin();
             cur != str.end(); ++cur)
         {
-            print_char(*cur, out);
+            switch (*cur)
+            {
+                case '<': case '>': case '&': case '"':
+                    out.write(run, cur - run);
+                    print_char(*cur, out);
+                    run = cur + 1;
+                    break;
+                default:
+                    break;
+            }
         }
+
+        out.write(run, str.end() - run);
     }
 
     char filter_identifier_char(char ch)
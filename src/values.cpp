@@ -75,7 +75,7 @@ namespace quickbook
             value_list_end_impl()
                 : value_node(value::default_tag)
             {
-                intrusive_ptr_add_ref(&instance);
+                ref_count_ = immortal;
                 next_ = this;
             }
 
@@ -135,7 +135,7 @@ namespace quickbook
             value_nil_impl()
                 : empty_value_impl(value::default_tag)
             {
-                intrusive_ptr_add_ref(&instance);
+                ref_count_ = immortal;
                 next_ = &value_list_end_impl::instance;
             }
         };
@@ -145,9 +145,8 @@ namespace quickbook
         value_node* empty_value_impl::new_(value::tag_type t) {
             // The return value from this function is always placed in an
             // intrusive_ptr which will manage the memory correctly.
-            // Note that value_nil_impl increments its reference count
-            // in its constructor, so that it will never be deleted by the
-            // intrusive pointer.
+            // Note that value_nil_impl is immortal, so that it will never
+            // be deleted by the intrusive pointer.
 
             if (t == value::default_tag)
                 return &value_nil_impl::instance;
@@ -169,9 +168,8 @@ namespace quickbook
         value_counted::value_counted()
             : value_base(&value_nil_impl::instance)
         {
-            // Even though empty is not on the heap, its reference
-            // counter needs to be incremented so that the destructor
-            // doesn't try to delete it.
+            // Empty is immortal, so this doesn't change its reference
+            // count, it's just consistent with the other constructors.
 
             intrusive_ptr_add_ref(value_);
         }
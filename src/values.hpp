@@ -63,14 +63,20 @@ namespace quickbook
 
             virtual value_node* get_list() const;
             
+            // The nil and list end values are shared by documents compiled
+            // in parallel, so they're never counted or deleted. Other
+            // values belong to a single document.
+            enum { immortal = -1 };
+
             int ref_count_;
             const tag_type tag_;
             value_node* next_;
 
             friend void intrusive_ptr_add_ref(value_node* ptr)
-                { ++ptr->ref_count_; }
+                { if(ptr->ref_count_ != immortal) ++ptr->ref_count_; }
             friend void intrusive_ptr_release(value_node* ptr)
-                { if(--ptr->ref_count_ == 0) delete ptr; }
+                { if(ptr->ref_count_ != immortal && --ptr->ref_count_ == 0)
+                    delete ptr; }
         };
 
         ////////////////////////////////////////////////////////////////////////
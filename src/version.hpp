@@ -0,0 +1,17 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_VERSION_HPP)
+#define BOOST_QUICKBOOK_VERSION_HPP
+
+// Also recorded in disk cache entries, so that entries written by another
+// version of quickbook aren't used. Update it when quickbook's output
+// changes.
+#define QUICKBOOK_VERSION "Quickbook Version 1.6.0 beta 1"
+
+#endif
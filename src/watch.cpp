@@ -0,0 +1,182 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "watch.hpp"
+
+#if QUICKBOOK_WATCH
+
+#include "input_path.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/foreach.hpp>
+#include <map>
+#include <set>
+#include <cstring>
+#include <cerrno>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace quickbook
+{
+    namespace
+    {
+        // Files are watched through their directories, which catches files
+        // being created and editors that save by renaming a new file over
+        // the old one.
+        uint32_t const watch_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+            IN_DELETE_SELF | IN_MOVE_SELF;
+
+        // How long to wait for more changes after the first one, so that
+        // a save which touches several files only triggers one build.
+        int const settle_milliseconds = 100;
+
+        struct inotify_handle
+        {
+            int fd;
+
+            inotify_handle() : fd(inotify_init1(IN_CLOEXEC)) {}
+            ~inotify_handle() { if (fd >= 0) ::close(fd); }
+
+        private:
+            inotify_handle(inotify_handle const&);
+            inotify_handle& operator=(inotify_handle const&);
+        };
+
+        file_stamp current_stamp(fs::path const& path)
+        {
+            struct stat info;
+            file_stamp stamp;
+
+            if (::stat(path.c_str(), &info) == 0) {
+                stamp.exists = true;
+                stamp.mtime_sec = info.st_mtim.tv_sec;
+                stamp.mtime_nsec = info.st_mtim.tv_nsec;
+                stamp.size = info.st_size;
+            }
+
+            return stamp;
+        }
+
+        // Read the pending events, returns true if any of them are for
+        // one of the paths.
+        bool read_events(int fd, std::map<int, fs::path> const& watches,
+                std::set<fs::path> const& paths)
+        {
+            char buffer[4096]
+                __attribute__ ((aligned(__alignof__(struct inotify_event))));
+            bool changed = false;
+
+            ssize_t length = ::read(fd, buffer, sizeof(buffer));
+            if (length < 0) return errno != EINTR && errno != EAGAIN;
+
+            for (char* ptr = buffer; ptr < buffer + length; )
+            {
+                inotify_event const* event =
+                    reinterpret_cast<inotify_event const*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+
+                // Missed events, or a watched directory has gone.
+                if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED |
+                        IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    changed = true;
+                    continue;
+                }
+
+                std::map<int, fs::path>::const_iterator dir =
+                    watches.find(event->wd);
+                if (dir == watches.end() || !event->len) continue;
+
+                if (paths.count(dir->second / event->name)) changed = true;
+            }
+
+            return changed;
+        }
+    }
+
+    file_stamps stamp_files(dependency_tracker::dependency_list const& files)
+    {
+        file_stamps stamps;
+
+        BOOST_FOREACH(dependency_tracker::dependency_list::value_type const& f,
+                files)
+        {
+            file_stamp stamp = current_stamp(f.first);
+
+            // Doesn't match how the build found the file, so make sure it
+            // doesn't match next time.
+            if (stamp.exists != f.second) {
+                stamp = file_stamp();
+                stamp.exists = f.second;
+            }
+
+            stamps[f.first] = stamp;
+        }
+
+        return stamps;
+    }
+
+    bool wait_for_change(file_stamps const& files)
+    {
+        inotify_handle handle;
+
+        if (handle.fd < 0) {
+            detail::outerr() << "Unable to watch files: "
+                << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        std::map<int, fs::path> watches;
+        std::set<fs::path> paths;
+
+        BOOST_FOREACH(file_stamps::value_type const& f, files)
+        {
+            paths.insert(f.first);
+
+            // For a missing file, watch the nearest directory that exists,
+            // and the directories in between, so that creating them is
+            // noticed.
+            fs::path dir = f.first.parent_path();
+            while (!dir.empty() && !fs::is_directory(dir)) {
+                paths.insert(dir);
+                dir = dir.parent_path();
+            }
+            if (dir.empty()) continue;
+
+            int wd = inotify_add_watch(handle.fd, dir.c_str(), watch_mask);
+
+            if (wd < 0) {
+                detail::outerr(dir) << "Unable to watch directory: "
+                    << std::strerror(errno) << std::endl;
+                return false;
+            }
+
+            watches[wd] = dir;
+        }
+
+        // Anything that changed since the files were stamped, before the
+        // watches were set up.
+        BOOST_FOREACH(file_stamps::value_type const& f, files)
+        {
+            if (current_stamp(f.first) != f.second) return true;
+        }
+
+        while (!read_events(handle.fd, watches, paths)) {}
+
+        pollfd p = { handle.fd, POLLIN, 0 };
+        while (::poll(&p, 1, settle_milliseconds) > 0) {
+            read_events(handle.fd, watches, paths);
+        }
+
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_WATCH_HPP)
+#define BOOST_QUICKBOOK_WATCH_HPP
+
+#include "dependency_tracker.hpp"
+#include <map>
+
+// Watching files for changes uses inotify, so it's only available on linux.
+
+#if defined(__linux__)
+#   define QUICKBOOK_WATCH 1
+#else
+#   define QUICKBOOK_WATCH 0
+#endif
+
+namespace quickbook
+{
+#if QUICKBOOK_WATCH
+    // The state of a dependency after a build. Changes are found by
+    // comparing these, rather than comparing modification times with the
+    // clock, which misses changes on file systems with coarse times.
+    struct file_stamp
+    {
+        file_stamp() : exists(false), mtime_sec(0), mtime_nsec(0), size(0) {}
+
+        bool exists;
+        long long mtime_sec;
+        long mtime_nsec;
+        long long size;
+
+        bool operator==(file_stamp const& x) const
+        {
+            return exists == x.exists && mtime_sec == x.mtime_sec &&
+                mtime_nsec == x.mtime_nsec && size == x.size;
+        }
+
+        bool operator!=(file_stamp const& x) const { return !(*this == x); }
+    };
+
+    typedef std::map<fs::path, file_stamp> file_stamps;
+
+    // Stamp the dependencies of a build, straight after it. A file that
+    // was created or deleted during the build gets a stamp that won't
+    // match, so that it's rebuilt.
+    file_stamps stamp_files(dependency_tracker::dependency_list const&);
+
+    // Block until one of the files changes. That includes a missing file
+    // being created, since that can change how an include is resolved.
+    // Returns false if the files can't be watched.
+    bool wait_for_change(file_stamps const&);
+#endif
+}
+
+#endif
@@ -0,0 +1,366 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Measures quickbook's throughput on generated documents. Writes a JSON
+# object per line for each document, with the time, peak memory and the
+# per-stage timings from '--timings', so that results can be compared
+# between builds.
+#
+# The 'prose' document is mostly plain paragraphs, so it measures the
+# cost of the innermost grammar rules. To see what the concrete lexical
+# parsers gain, compare with a build of quickbook using
+# 'define=QUICKBOOK_DYNAMIC_LEXICAL_RULES'.
+#
+# The 'nested' documents contain unclosed phrase elements nested to the
+# given depth, which take exponential time to parse unless quickbook is
+# run with '--quickbook-args=--memoize-elements'. They have errors, so
+# quickbook's exit code is ignored for them, and there's no output.
+#
+# Usage: benchmark.py [options] quickbook-command
+
+from __future__ import print_function
+
+import sys, os, re, json, time, shutil, subprocess, tempfile, optparse
+
+test_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+def main():
+    parser = optparse.OptionParser(
+            usage = 'usage: %prog [options] quickbook-command')
+    parser.add_option('--sizes', default = '1,10',
+            help = 'comma separated sizes in MB for the replicated manual '
+                '(default: %default)')
+    parser.add_option('--size', type = 'int', default = 10,
+            help = 'size in MB of the other documents (default: %default)')
+    parser.add_option('--ids', type = 'int', default = 100000,
+            help = 'number of ids in the id document (default: %default)')
+    parser.add_option('--nesting', default = '8,12,16',
+            help = 'comma separated depths for the nested element documents '
+                '(default: %default)')
+    parser.add_option('--quickbook-args', default = '',
+            help = 'extra arguments for quickbook, separated by spaces')
+    parser.add_option('--repeat', type = 'int', default = 3,
+            help = 'times to run each document, the fastest run is reported '
+                '(default: %default)')
+    parser.add_option('--only', default = None,
+            help = 'comma separated list of documents to run')
+    parser.add_option('--output', default = None,
+            help = 'write results to a file as well as stdout')
+    parser.add_option('--keep', default = None,
+            help = 'generate documents in this directory, and keep them')
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        parser.error('quickbook command required')
+    quickbook_command = os.path.abspath(args[0])
+
+    documents = []
+    for size in options.sizes.split(','):
+        documents.append(('manual-%sMB' % size, generate_manual,
+            int(size) * 1024 * 1024))
+    documents.append(('prose-%dMB' % options.size, generate_prose,
+        options.size * 1024 * 1024))
+    documents.append(('templates-%dMB' % options.size, generate_templates,
+        options.size * 1024 * 1024))
+    documents.append(('code-%dMB' % options.size, generate_code,
+        options.size * 1024 * 1024))
+    documents.append(('ids-%d' % options.ids, generate_ids, options.ids))
+    for depth in options.nesting.split(','):
+        documents.append(('nested-%s' % depth, generate_nested, int(depth)))
+
+    if options.only:
+        only = options.only.split(',')
+        documents = [d for d in documents if d[0] in only]
+
+    work_dir = options.keep or tempfile.mkdtemp()
+    output = open(options.output, 'w') if options.output else None
+
+    try:
+        # The manual imports '../test/stub.cpp'.
+        corpus_dir = os.path.join(work_dir, 'corpus')
+        stub_dir = os.path.join(work_dir, 'test')
+        for directory in [corpus_dir, stub_dir]:
+            if not os.path.isdir(directory): os.makedirs(directory)
+        for stub in ['stub.c', 'stub.cpp', 'stub.py']:
+            shutil.copy(os.path.join(test_dir, stub), stub_dir)
+
+        for (name, generator, size) in documents:
+            filename = os.path.join(corpus_dir, name + '.qbk')
+            if not os.path.exists(filename):
+                write_file(filename, generator(size))
+
+            result = run_benchmark(quickbook_command, name, filename,
+                    options.repeat, options.quickbook_args.split(),
+                    name.startswith('nested-'))
+            line = json.dumps(result, sort_keys = True)
+            print(line)
+            sys.stdout.flush()
+            if output: output.write(line + '\n')
+    finally:
+        if output: output.close()
+        if not options.keep: shutil.rmtree(work_dir)
+
+################################################################################
+# Running
+
+def run_benchmark(quickbook_command, name, filename, repeat, extra_args,
+        has_errors = False):
+    output_filename = os.path.splitext(filename)[0] + '.xml'
+    command = [quickbook_command, '--timings', filename,
+            '--output-file', output_filename] + extra_args
+
+    best = None
+
+    for i in range(repeat):
+        (exit_code, seconds, peak_rss, stdout) = run_command(command)
+        if exit_code != 0 and not (has_errors and exit_code == 1):
+            return { 'document': name, 'error': 'exit code %d' % exit_code }
+        if best is None or seconds < best[0]:
+            best = (seconds, peak_rss, stdout)
+
+    (seconds, peak_rss, stdout) = best
+    size = os.path.getsize(filename)
+
+    return {
+        'document': name,
+        'bytes_in': size,
+        'bytes_out': os.path.getsize(output_filename)
+            if os.path.exists(output_filename) else 0,
+        'seconds': round(seconds, 4),
+        'mb_per_s': round(size / seconds / (1024 * 1024), 3),
+        'peak_rss_kb': peak_rss,
+        'stages': parse_timings(stdout),
+    }
+
+def run_command(command):
+    stdout = tempfile.TemporaryFile()
+    start = time.time()
+    process = subprocess.Popen(command, stdout = stdout,
+            stderr = open(os.devnull, 'w'))
+
+    # wait4 gives the peak memory of just this process. On linux ru_maxrss
+    # is in KB, but it's in bytes on OS X.
+    (pid, status, usage) = os.wait4(process.pid, 0)
+    seconds = time.time() - start
+    peak_rss = usage.ru_maxrss
+    if sys.platform == 'darwin': peak_rss //= 1024
+    exit_code = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+
+    stdout.seek(0)
+    return (exit_code, seconds, peak_rss, stdout.read().decode('utf-8'))
+
+timings_line = re.compile(
+        r'^  (\S+)\s+([\d.]+)\s+([\d.]+)\s+(\d+)\s+(\d+)\s+([\d.]+|-)$')
+
+def parse_timings(stdout):
+    stages = {}
+    for line in stdout.splitlines():
+        if not line.strip(): break # Only the phases, not included files.
+        m = timings_line.match(line)
+        if m:
+            stages[m.group(1)] = {
+                'wall_ms': float(m.group(2)),
+                'cpu_ms': float(m.group(3)),
+                'bytes_in': int(m.group(4)),
+                'bytes_out': int(m.group(5)),
+                'mb_per_s': None if m.group(6) == '-' else float(m.group(6)),
+            }
+    return stages
+
+################################################################################
+# Documents
+
+def write_file(filename, content):
+    f = open(filename, 'w')
+    try:
+        f.write(content)
+    finally:
+        f.close()
+
+# The quickbook manual, with its body repeated in sections until it's
+# big enough. Templates, macros and imports are only defined once.
+def generate_manual(size):
+    source = open(os.path.join(test_dir, 'quickbook_manual-1_4.quickbook')).read()
+    split = source.index('\n]\n') + 3
+    (head, body) = (source[:split], source[split:])
+    (body, definitions) = extract_definitions(body)
+
+    parts = [head, '\n'.join(definitions), '\n']
+    total = sum(len(x) for x in parts)
+    count = 0
+    while total < size:
+        part = '[section:copy%d Copy %d]\n%s\n[endsect]\n' % (count, count, body)
+        parts.append(part)
+        total += len(part)
+        count += 1
+    return ''.join(parts)
+
+def extract_definitions(text):
+    result = []
+    definitions = []
+    names = set()
+    pos = 0
+    definition = re.compile(r'\[(template|def|import)\s+([^\s\[\]\\]+)')
+    while True:
+        m = definition.search(text, pos)
+        if not m:
+            result.append(text[pos:])
+            break
+        result.append(text[pos:m.start()])
+        end = find_close(text, m.start())
+        if m.groups() not in names:
+            names.add(m.groups())
+            definitions.append(text[m.start():end])
+        pos = end
+    return (''.join(result), definitions)
+
+def find_close(text, pos):
+    depth = 0
+    while pos < len(text):
+        c = text[pos]
+        if c == '\\':
+            pos += 1
+        elif c == '[':
+            depth += 1
+        elif c == ']':
+            depth -= 1
+            if depth == 0: return pos + 1
+        pos += 1
+    return pos
+
+# Plain paragraphs, with only the occasional bit of markup or a comment.
+def generate_prose(size):
+    sentences = [
+        'The quick brown fox jumps over the lazy dog, again and again.',
+        'Documentation is mostly text, with very little markup in it.',
+        'Each paragraph is separated from the next by a blank line.',
+        'Some sentences have *bold* or /italic/ words, but most do not.',
+        'Lines are wrapped at a reasonable length, as they would be when',
+        'written by hand, so there are plenty of line breaks in a paragraph.',
+        '[/ A comment, which is skipped. ] Then more text follows it.',
+        'Punctuation: commas, full stops; colons and - dashes - are common.',
+    ]
+    parts = ['''[article Prose
+[quickbook 1.6]
+]
+
+''']
+    total = len(parts[0])
+    count = 0
+    while total < size:
+        paragraphs = ['\n'.join(sentences[(i + j) % len(sentences)]
+            for j in range(5)) for i in range(8)]
+        part = '[section:p%d Prose %d]\n\n%s\n\n[endsect]\n\n' % (
+            count, count, '\n\n'.join(paragraphs))
+        parts.append(part)
+        total += len(part)
+        count += 1
+    return ''.join(parts)
+
+# Lots of small, nested template calls.
+def generate_templates(size):
+    parts = ['''[article Templates
+[quickbook 1.6]
+]
+
+[template emph[x] ['[x]]]
+[template strong[x] [*[x]]]
+[template term[name] [strong [name]]]
+[template pair[a b] [emph [a]] and [term [b]]]
+[template nested[x] [pair [x]..[emph [x] again]]]
+[template note_block[title body]
+[note [title]: [body]]
+]
+[template plain Plain template text without arguments.]
+
+''']
+    total = len(parts[0])
+    count = 0
+    while total < size:
+        part = ('[section:t%d Templates %d]\n\n'
+            'Some text with [emph emphasis], a [term term %d], '
+            'a [pair first..second] and [nested value %d]. [plain]\n\n'
+            '[note_block Title %d..Body of the note, with [strong strong] text.]\n\n'
+            'A longer paragraph which calls [emph one], [emph two], '
+            '[strong three], [term four] and [pair five..six] in turn.\n\n'
+            '[endsect]\n\n') % (count, count, count, count, count)
+        parts.append(part)
+        total += len(part)
+        count += 1
+    return ''.join(parts)
+
+# Mostly code blocks to be syntax highlighted, with some inline code.
+def generate_code(size):
+    cpp = '''    // A comment, and a string "with \\"escapes\\"".
+    template <typename T>
+    class example%d : public base<T>
+    {
+    public:
+        explicit example%d(T const& x) : value_(x) {}
+        int compute(int a, int b) const { return a * %d + b / 2; }
+        /* A block comment */
+    private:
+        T value_;
+    };
+'''
+    python = '''    def example%d(x, y = 'string'):
+        # A comment
+        return [i * %d for i in range(x)] + [y]
+'''
+    parts = ['''[article Code
+[quickbook 1.6]
+]
+
+''']
+    total = len(parts[0])
+    count = 0
+    while total < size:
+        part = ('[section:c%d Code %d]\n\n'
+            'Call `example%d::compute` or `std::vector<int>` like this:\n\n'
+            '%s\n[python]\n\n%s\n[c++]\n\n[endsect]\n\n') % (
+                count, count, count,
+                cpp % (count, count, count), python % (count, count))
+        parts.append(part)
+        total += len(part)
+        count += 1
+    return ''.join(parts)
+
+# A document with a lot of ids, many of them duplicates, so that id
+# generation has to resolve clashes.
+def generate_ids(count):
+    parts = ['''[article Ids
+[quickbook 1.6]
+]
+
+''']
+    generated = 0
+    section = 0
+    while generated < count:
+        parts.append(
+            '[section Overview]\n\n[heading Details]\n\n[#anchor%d]\n'
+            '[heading Details]\n\nText.\n\n[endsect]\n\n' % section)
+        generated += 4
+        section += 1
+    return ''.join(parts)
+
+# Unclosed phrase elements, nested 'depth' deep. Before quickbook 1.7 each
+# one fails softly and is reparsed as plain text, so without memoization
+# the parse time doubles with each level.
+def generate_nested(depth):
+    openers = ['[@http://example.com/ ', '[link some_id ', '[role red ']
+    parts = ['''[article Nested
+[quickbook 1.6]
+]
+
+Some text, ''']
+    for i in range(depth):
+        parts.append(openers[i % len(openers)])
+        parts.append('level %d ' % i)
+    parts.append('and the end of the paragraph.\n')
+    return ''.join(parts)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,115 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// Compares newline normalization with the character at a time loop that
+// it replaced, on input with unix, windows and mixed newlines.
+//
+// Usage: normalize_benchmark [size in MB]
+
+#include "files.hpp"
+#include <boost/timer/timer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <string>
+
+namespace
+{
+    // The old implementation.
+    void normalize_loop(boost::string_ref x, std::string& out)
+    {
+        std::back_insert_iterator<std::string> it(out);
+        boost::string_ref::const_iterator begin = x.begin(), end = x.end();
+
+        while(begin != end) {
+            if(*begin == '\r') {
+                *it++ = '\n';
+                ++begin;
+                if(begin != end && *begin == '\n') ++begin;
+            }
+            else {
+                *it++ = *begin++;
+            }
+        }
+    }
+
+    std::string generate(std::size_t size, char const* const* newlines)
+    {
+        char const* line = "Some text, with [*markup] and a `code` phrase.";
+        std::string result;
+        result.reserve(size + 100);
+
+        for (unsigned i = 0; result.size() < size; ++i) {
+            result.append(line, line + 20 + i % 27);
+            result += newlines[i % 4];
+        }
+
+        return result;
+    }
+
+    template <typename Function>
+    double run(Function f, std::string const& input, std::string& output)
+    {
+        double best = 0;
+
+        for (int i = 0; i < 5; ++i) {
+            output.clear();
+            boost::timer::cpu_timer timer;
+            f(input, output);
+            double seconds = timer.elapsed().wall / 1e9;
+            if (i == 0 || seconds < best) best = seconds;
+        }
+
+        return input.size() / best / (1024 * 1024);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t size = (argc > 1 ?
+        boost::lexical_cast<std::size_t>(argv[1]) : 16) * 1024 * 1024;
+
+    char const* unix_newlines[] = { "\n", "\n", "\n", "\n" };
+    char const* windows_newlines[] = { "\r\n", "\r\n", "\r\n", "\r\n" };
+    char const* mixed_newlines[] = { "\n", "\r\n", "\n", "\r" };
+
+    struct { char const* name; char const* const* newlines; } inputs[] = {
+        { "LF", unix_newlines },
+        { "CRLF", windows_newlines },
+        { "mixed", mixed_newlines }
+    };
+
+    std::cout << std::left << std::setw(8) << "input" << std::right
+        << std::setw(14) << "loop MB/s"
+        << std::setw(14) << "bulk MB/s" << "\n";
+
+    int error_count = 0;
+
+    for (unsigned i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+        std::string input = generate(size, inputs[i].newlines);
+        std::string expected, result;
+        expected.reserve(input.size());
+        result.reserve(input.size());
+
+        double loop = run(normalize_loop, input, expected);
+        double bulk = run(quickbook::normalize_newlines, input, result);
+
+        std::cout << std::left << std::setw(8) << inputs[i].name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << loop
+            << std::setw(14) << bulk << "\n";
+
+        if (result != expected) {
+            std::cerr << "Output differs for " << inputs[i].name << "\n";
+            ++error_count;
+        }
+    }
+
+    return error_count ? 1 : 0;
+}
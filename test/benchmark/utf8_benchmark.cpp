@@ -0,0 +1,125 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// Compares UTF-8 validation, which also looks for carriage returns, with
+// the search for carriage returns that loading did before, on valid
+// input with different amounts of non-ASCII text.
+//
+// Usage: utf8_benchmark [size in MB]
+
+#include "files.hpp"
+#include <boost/timer/timer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+
+namespace
+{
+    // The old check, which only looked for carriage returns.
+    bool find_cr(boost::string_ref x)
+    {
+        return std::memchr(x.data(), '\r', x.size()) != 0;
+    }
+
+    bool validate(boost::string_ref x)
+    {
+        bool has_cr = false;
+        if (quickbook::check_utf8(x, has_cr) != std::string::npos)
+            throw std::runtime_error("Invalid UTF-8");
+        return has_cr;
+    }
+
+    std::string generate(std::size_t size, char const* const* lines)
+    {
+        std::string result;
+        result.reserve(size + 100);
+
+        for (unsigned i = 0; result.size() < size; ++i) {
+            result += lines[i % 4];
+            result += '\n';
+        }
+
+        return result;
+    }
+
+    template <typename Function>
+    double run(Function f, std::string const& input, bool& result)
+    {
+        double best = 0;
+
+        for (int i = 0; i < 5; ++i) {
+            boost::timer::cpu_timer timer;
+            result = f(input);
+            double seconds = timer.elapsed().wall / 1e9;
+            if (i == 0 || seconds < best) best = seconds;
+        }
+
+        return input.size() / best / (1024 * 1024);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t size = (argc > 1 ?
+        boost::lexical_cast<std::size_t>(argv[1]) : 16) * 1024 * 1024;
+
+    char const* ascii_lines[] = {
+        "Some text, with [*markup] and a `code` phrase.",
+        "[section:id A section title]",
+        "    int main() { return 0; }",
+        ""
+    };
+
+    char const* accented_lines[] = {
+        "Some text, with [*markup] and a `code` phrase.",
+        "Iñtërnâtiônàlizætiøn",
+        "    int main() { return 0; }",
+        "A caf\xc3\xa9 and a na\xc3\xafve r\xc3\xa9sum\xc3\xa9."
+    };
+
+    char const* greek_lines[] = {
+        "* Αα Alpha * Ββ Beta * Γγ Gamma",
+        "Ελληνικά κείμενα με πολλούς χαρακτήρες",
+        "* Δδ Delta * Εε Epsilon",
+        "Ζζ Ηη Θθ Ιι Κκ Λλ Μμ Νν Ξξ"
+    };
+
+    struct { char const* name; char const* const* lines; } inputs[] = {
+        { "ASCII", ascii_lines },
+        { "accents", accented_lines },
+        { "greek", greek_lines }
+    };
+
+    std::cout << std::left << std::setw(8) << "input" << std::right
+        << std::setw(14) << "memchr MB/s"
+        << std::setw(14) << "utf8 MB/s" << "\n";
+
+    int error_count = 0;
+
+    for (unsigned i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+        std::string input = generate(size, inputs[i].lines);
+        bool expected, result;
+
+        double search = run(find_cr, input, expected);
+        double check = run(validate, input, result);
+
+        std::cout << std::left << std::setw(8) << inputs[i].name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << search
+            << std::setw(14) << check << "\n";
+
+        if (result != expected) {
+            std::cerr << "Result differs for " << inputs[i].name << "\n";
+            ++error_count;
+        }
+    }
+
+    return error_count ? 1 : 0;
+}
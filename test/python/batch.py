@@ -0,0 +1,187 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests for compiling a list of documents with --batch. Run with the path to
+# quickbook, e.g.
+#
+#     python batch.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: batch.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    failures = 0
+    for test in [batch_file_format, failed_documents, invalid_batch_files]:
+        directory = tempfile.mkdtemp()
+        try:
+            failures += test(quickbook_command, directory)
+        finally:
+            shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# Comments, blank lines, quoted paths and default output files. Each
+# document's output should be the same as when it's compiled on its own.
+def batch_file_format(quickbook_command, directory):
+    failures = 0
+
+    write_document(directory, 'one.qbk', 'One')
+    os.mkdir(os.path.join(directory, 'with space'))
+    write_document(directory, os.path.join('with space', 'two.qbk'), 'Two')
+    write_file(os.path.join(directory, 'list.txt'),
+        '# A comment\n'
+        '\n'
+        'one.qbk\n'
+        '  "with space/two.qbk"\t"out two.xml"  \n')
+
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'list.txt'])
+
+    if exit_code != 0:
+        print("Error compiling batch:")
+        print(stderr)
+        failures += 1
+
+    for source, output in [('one.qbk', 'one.xml'),
+            (os.path.join('with space', 'two.qbk'), 'out two.xml')]:
+        expected = compile_one(quickbook_command, directory, source)
+        output_path = os.path.join(directory, output)
+        if not os.path.exists(output_path):
+            print("No output for %s." % source)
+            failures += 1
+        elif read_file(output_path) != expected:
+            print("Wrong output for %s:" % source)
+            print(read_file(output_path))
+            failures += 1
+
+    return failures
+
+# A document with an error shouldn't stop the others, and should be counted
+# in the summary and the exit code.
+def failed_documents(quickbook_command, directory):
+    failures = 0
+
+    write_document(directory, 'one.qbk', 'One')
+    write_document(directory, 'bad.qbk', 'Bad', '[section A]\n[endsect]\n[endsect]\n')
+    write_document(directory, 'three.qbk', 'Three')
+    write_document(directory, 'worse.qbk', 'Worse', '[endsect]\n')
+    write_file(os.path.join(directory, 'list.txt'),
+        'one.qbk\nbad.qbk\nthree.qbk\nworse.qbk\n')
+
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'list.txt'])
+
+    if exit_code != 2:
+        print("Expected exit code 2, got %d." % exit_code)
+        failures += 1
+
+    for filename in ['bad.qbk', 'worse.qbk']:
+        if ('%s:' % filename) not in stderr:
+            print("No error reported for %s:" % filename)
+            print(stderr)
+            failures += 1
+
+    if not stderr.rstrip().endswith('2 of 4 documents failed.'):
+        print("Missing summary:")
+        print(stderr)
+        failures += 1
+
+    for name in ['one', 'three']:
+        if not os.path.exists(os.path.join(directory, name + '.xml')):
+            print("No output for %s.qbk." % name)
+            failures += 1
+
+    for name in ['bad', 'worse']:
+        if os.path.exists(os.path.join(directory, name + '.xml')):
+            print("Output written for %s.qbk." % name)
+            failures += 1
+
+    # '--expect-errors' inverts the result.
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'list.txt', '--expect-errors'])
+    if exit_code != 0:
+        print("Failed with --expect-errors.")
+        failures += 1
+
+    return failures
+
+# Errors in the batch file are reported with their line, and nothing is
+# compiled.
+def invalid_batch_files(quickbook_command, directory):
+    failures = 0
+
+    write_document(directory, 'one.qbk', 'One')
+    write_file(os.path.join(directory, 'list.txt'),
+        'one.qbk\n# Comment\none.qbk one.xml extra\n')
+
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'list.txt'])
+
+    if exit_code == 0:
+        print("No error for too many fields.")
+        failures += 1
+    if 'list.txt:3: error: Too many fields' not in stderr:
+        print("Wrong error for too many fields:")
+        print(stderr)
+        failures += 1
+    if os.path.exists(os.path.join(directory, 'one.xml')):
+        print("Documents compiled from invalid batch file.")
+        failures += 1
+
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'missing.txt'])
+
+    if exit_code == 0 or 'missing.txt: error:' not in stderr:
+        print("Wrong result for missing batch file:")
+        print(stderr)
+        failures += 1
+
+    exit_code, stdout, stderr = run(quickbook_command, directory,
+        ['--batch', 'list.txt', 'one.qbk'])
+
+    if exit_code == 0 or "--batch can't be used" not in stderr:
+        print("Wrong result for batch with an input file:")
+        print(stderr)
+        failures += 1
+
+    return failures
+
+def compile_one(quickbook_command, directory, source):
+    output_path = os.path.join(directory, 'single.xml')
+    run(quickbook_command, directory, [source, '--output-file', output_path])
+    output = read_file(output_path)
+    os.remove(output_path)
+    return output
+
+def run(quickbook_command, directory, args):
+    process = subprocess.Popen([quickbook_command, '--debug'] + args,
+        cwd = directory, stdout = subprocess.PIPE, stderr = subprocess.PIPE,
+        universal_newlines = True)
+    stdout, stderr = process.communicate()
+    return process.returncode, stdout, stderr
+
+def write_document(directory, filename, title, body = 'Some text.\n'):
+    write_file(os.path.join(directory, filename),
+        '[article %s\n[quickbook 1.5]]\n\n%s' % (title, body))
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename) as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,166 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests that compiling a batch in parallel gives the same result as a
+# serial run. Run with the path to quickbook, e.g.
+#
+#     python batch_jobs.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil, glob
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: batch_jobs.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    failures = 0
+    for test in [same_output, shared_snippets]:
+        directory = tempfile.mkdtemp()
+        try:
+            failures += test(quickbook_command, directory)
+        finally:
+            shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# Compile the documents from the test directory, including the ones that
+# fail, with different numbers of jobs. The generated files, the messages
+# and their order, and the exit code should always be the same.
+def same_output(quickbook_command, directory):
+    failures = 0
+    test_directory = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+        '..')
+    documents = sorted(os.path.basename(x) for x in
+        glob.glob(os.path.join(test_directory, '*.quickbook')))
+
+    results = {}
+    for jobs in [1, 2, 4, 8]:
+        output_directory = os.path.join(directory, str(jobs))
+        os.mkdir(output_directory)
+        batch_path = os.path.join(directory, 'list%d.txt' % jobs)
+        write_file(batch_path, ''.join('"%s" "%s"\n' %
+            (x, os.path.join(output_directory, x + '.xml'))
+            for x in documents))
+
+        process = subprocess.Popen([quickbook_command, '--debug',
+                '--batch', batch_path, '--jobs', str(jobs)],
+            cwd = test_directory,
+            stdout = subprocess.PIPE, stderr = subprocess.PIPE,
+            universal_newlines = True)
+        stdout, stderr = process.communicate()
+        stdout = stdout.replace(output_directory, 'OUTPUT')
+        stderr = stderr.replace(output_directory, 'OUTPUT')
+
+        outputs = {}
+        for x in documents:
+            path = os.path.join(output_directory, x + '.xml')
+            if os.path.exists(path):
+                outputs[x] = read_file(path)
+
+        results[jobs] = (process.returncode, stdout, stderr, outputs)
+
+    expected = results[1]
+    if not expected[3]:
+        print("No documents compiled.")
+        failures += 1
+
+    for jobs in sorted(results):
+        exit_code, stdout, stderr, outputs = results[jobs]
+        if exit_code != expected[0]:
+            print("Different exit code with %d jobs." % jobs)
+            failures += 1
+        if stdout != expected[1]:
+            print("Different output messages with %d jobs:" % jobs)
+            print(stdout)
+            failures += 1
+        if stderr != expected[2]:
+            print("Different error messages with %d jobs:" % jobs)
+            print(stderr)
+            failures += 1
+        if sorted(outputs) != sorted(expected[3]):
+            print("Different files generated with %d jobs." % jobs)
+            failures += 1
+        for x in outputs:
+            if x in expected[3] and outputs[x] != expected[3][x]:
+                print("Different output for %s with %d jobs." % (x, jobs))
+                failures += 1
+
+    return failures
+
+# Documents in different directories import the same code file, so they
+# share its cached snippets. An error in a snippet should be reported using
+# the path that each document imported it with.
+def shared_snippets(quickbook_command, directory):
+    failures = 0
+
+    os.mkdir(os.path.join(directory, 'lib'))
+    write_file(os.path.join(directory, 'lib', 'code.cpp'),
+        '//[ example\n'
+        'int x; // ``[greet one..two]``\n'
+        '//]\n')
+
+    # Each document is at a different depth, so it imports the code file
+    # with a different path. They're also compiled using their absolute
+    # paths, which import the file with the same absolute path, but should
+    # still report it with the path they used.
+    documents = ['a/doc.qbk', 'b/sub/doc.qbk', 'c/sub/sub/doc.qbk']
+    imports = []
+    for document in documents:
+        path = os.path.join(directory, *document.split('/'))
+        os.makedirs(os.path.dirname(path))
+        relative = '../' * document.count('/') + 'lib/code.cpp'
+        write_file(path,
+            '[article Doc\n[quickbook 1.5]]\n\n'
+            '[template greet[name] Hello [name].]\n\n'
+            '[import %s]\n\n'
+            '[example]\n' % relative)
+        imports.append(os.path.dirname(document) + '/' + relative)
+    prefix = directory.replace(os.sep, '/') + '/'
+    documents += [prefix + x for x in documents]
+    imports += [prefix + x for x in imports]
+    write_file(os.path.join(directory, 'list.txt'),
+        ''.join('"%s"\n' % x for x in documents))
+
+    for jobs in [1, 4]:
+        process = subprocess.Popen([quickbook_command, '--debug',
+                '--batch', 'list.txt', '--jobs', str(jobs)],
+            cwd = directory,
+            stdout = subprocess.PIPE, stderr = subprocess.PIPE,
+            universal_newlines = True)
+        stdout, stderr = process.communicate()
+
+        errors = [x for x in stderr.splitlines() if 'code.cpp:2: error' in x]
+
+        if len(errors) != len(documents):
+            print("Wrong errors with %d jobs:" % jobs)
+            print(stderr)
+            failures += 1
+            continue
+
+        for error, path in zip(errors, imports):
+            if not error.startswith(path + ':2: error'):
+                print("Error reported with the wrong path with %d jobs, "
+                    "expected %s:" % (jobs, path))
+                print(error)
+                failures += 1
+
+    return failures
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename, 'rb') as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,188 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests for the cache of included files. Run with the path to quickbook, e.g.
+#
+#     python include_cache.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil, glob
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: include_cache.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    failures = 0
+    for test in [changes, other_versions]:
+        directory = tempfile.mkdtemp()
+        try:
+            failures += test(quickbook_command, directory)
+        finally:
+            shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# Compile a document after a series of changes, checking that the output
+# with the cache is always the same as the output without it.
+def changes(quickbook_command, directory):
+    failures = 0
+    cache_dir = os.path.join(directory, 'cache')
+    os.mkdir(cache_dir)
+
+    write_file(os.path.join(directory, 'doc.qbk'),
+        '[article Doc\n[quickbook 1.6]]\n\n'
+        '[template greeting[name] Hello [name].]\n'
+        '[def __macro__ A macro.]\n'
+        '[import code.cpp]\n\n'
+        '[section First]\n\n[include section.qbk]\n\n[endsect]\n')
+    write_file(os.path.join(directory, 'section.qbk'),
+        '[section:inner Inner]\n\n'
+        '[#anchor] [greeting World] __macro__\n\n'
+        '[heading Heading]\n\n[link anchor Link]\n\n'
+        '[include nested.qbk]\n\n[include extra.qbk]\n\n[endsect]\n')
+    write_file(os.path.join(directory, 'nested.qbk'),
+        '[table Table\n[[Cell]]]\n\n[example]\n')
+    # Snippets are cached with the positions they came from, which are used
+    # for the callout and for errors.
+    write_file(os.path.join(directory, 'code.cpp'),
+        '//[ example\n'
+        'int main() {\n'
+        '    int x; /*< A callout. >*/\n'
+        '    // `` `escaped` ``\n'
+        '}\n'
+        '//]\n')
+    os.mkdir(os.path.join(directory, 'include'))
+    write_file(os.path.join(directory, 'include', 'extra.qbk'),
+        'Found in the include path.\n')
+
+    edits = [
+        ('unchanged', None, None, None),
+        ('nested file', 'nested.qbk', 'Cell', 'Changed cell'),
+        ('template', 'doc.qbk', 'Hello', 'Goodbye'),
+        ('code file', 'code.cpp', 'int x;', 'long x;'),
+        ('macro', 'doc.qbk', 'A macro.', 'Another macro.'),
+        ('ids before include', 'doc.qbk', '[section First]',
+            '[section Zero]\n\n[heading Heading]\n\n[endsect]\n\n'
+            '[section First]'),
+        # 'extra.qbk' is found in the include path, until one is added
+        # next to the file that includes it.
+        ('added file', 'extra.qbk', None, 'Found locally.\n'),
+    ]
+
+    for name, filename, old, new in edits:
+        if filename:
+            path = os.path.join(directory, filename)
+            if old:
+                write_file(path, read_file(path).replace(old, new))
+            else:
+                write_file(path, new)
+
+        # First use the cache left by the previous change, then an empty
+        # cache, then the cache that filled.
+        expected = compile(quickbook_command, directory, [])
+        for run in ['previous', 'empty', 'filled']:
+            if run == 'empty':
+                shutil.rmtree(cache_dir)
+                os.mkdir(cache_dir)
+            output = compile(quickbook_command, directory,
+                ['--cache-dir', cache_dir])
+            if output != expected:
+                print("Wrong output after '%s', %s cache:" % (name, run))
+                print(output)
+                failures += 1
+
+    return failures
+
+# An entry written by another version of quickbook shouldn't be used. To
+# tell whether it was, change the cached output, first leaving the version
+# alone to check that the changed output is used.
+def other_versions(quickbook_command, directory):
+    failures = 0
+    cache_dir = os.path.join(directory, 'cache')
+    os.mkdir(cache_dir)
+
+    write_file(os.path.join(directory, 'doc.qbk'),
+        '[article Doc\n[quickbook 1.6]]\n\n'
+        '[section First]\n\n[include section.qbk]\n\n[endsect]\n')
+    write_file(os.path.join(directory, 'section.qbk'),
+        '[section:inner Inner]\n\nSome text.\n\n[endsect]\n')
+
+    expected = compile(quickbook_command, directory,
+        ['--cache-dir', cache_dir])
+    entries = glob.glob(os.path.join(cache_dir, 'include-*'))
+    if len(entries) != 1:
+        print("Expected one include entry, found %d." % len(entries))
+        return 1
+    entry = read_binary_file(entries[0])
+
+    version = subprocess.check_output([quickbook_command, '--version'],
+        universal_newlines = True).split(' (')[0].encode('utf-8')
+    if version not in entry:
+        print("Version not found in cache entry.")
+        return 1
+    other_version = version[:-1] + (b'0' if version[-1:] != b'0' else b'1')
+
+    # Only the output after the included file's contents is changed, as the
+    # contents are checked.
+    changed = entry.replace(b'Some text.</para>', b'Some TEXT.</para>')
+    if changed == entry:
+        print("Output not found in cache entry.")
+        return 1
+
+    other = changed.replace(version, other_version)
+    for name, data, used in [('same version', changed, True),
+            ('other version', other, False)]:
+        write_binary_file(entries[0], data)
+        output = compile(quickbook_command, directory,
+            ['--cache-dir', cache_dir])
+        if output is None or ('Some TEXT.' in output) != used:
+            print("Cache entry with %s %s." %
+                (name, "wasn't used" if used else "was used"))
+            print(output)
+            failures += 1
+        elif not used and output != expected:
+            print("Wrong output with %s:" % name)
+            print(output)
+            failures += 1
+
+    return failures
+
+def compile(quickbook_command, directory, args):
+    output_path = os.path.join(directory, 'doc.xml')
+    with open(os.devnull, 'w') as devnull:
+        subprocess.call([quickbook_command, 'doc.qbk', '--debug',
+            '-I', 'include', '--output-file', output_path] + args,
+            cwd = directory, stdout = devnull, stderr = devnull)
+    # No output is written when there's an error.
+    if not os.path.exists(output_path):
+        return None
+    output = read_file(output_path)
+    os.remove(output_path)
+    return output
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename) as f:
+        return f.read()
+
+def write_binary_file(filename, data):
+    with open(filename, 'wb') as f:
+        f.write(data)
+
+def read_binary_file(filename):
+    with open(filename, 'rb') as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
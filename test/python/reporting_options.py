@@ -0,0 +1,226 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests for the options that report on a build. Run with the path to
+# quickbook, e.g.
+#
+#     python reporting_options.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil, glob, json
+
+test_directory = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: reporting_options.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    failures = 0
+    for test in [unchanged_output, valid_trace, template_call_counts,
+            prefetched_includes]:
+        directory = tempfile.mkdtemp()
+        try:
+            failures += test(quickbook_command, directory)
+        finally:
+            shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# The options, and text that should be in their report, or None if it's
+# written to a file or there isn't one. '$DIR' is replaced with a temporary
+# directory.
+options = [
+    (['--timings'], 'Timings for '),
+    (['--trace-out', '$DIR/trace.json'], None),
+    (['--template-stats'], 'Template statistics'),
+    (['--prefetch'], None),
+]
+
+# Reporting on a build shouldn't change its output. Compile the documents
+# from the test directory with each option, and compare the output with a
+# plain build.
+def unchanged_output(quickbook_command, directory):
+    failures = 0
+    documents = sorted(os.path.basename(x)[:-len('.gold')] for x in
+        glob.glob(os.path.join(test_directory, '*.gold')))
+
+    for document in documents:
+        expected = compile(quickbook_command, directory, document, [])[2]
+        if expected is None:
+            print("Error compiling %s." % document)
+            failures += 1
+            continue
+
+        for args, report in options:
+            args = [x.replace('$DIR', directory) for x in args]
+            stdout, stderr, output = compile(quickbook_command, directory,
+                document, args)
+            if output != expected:
+                print("Output of %s changed with %s." %
+                    (document, ' '.join(args)))
+                failures += 1
+            if report and report not in stdout:
+                print("No report for %s with %s:" %
+                    (document, ' '.join(args)))
+                print(stdout)
+                failures += 1
+
+    return failures
+
+# The trace should be valid JSON, with every span that's started ended
+# afterwards, in the right order. That includes a document with an error.
+def valid_trace(quickbook_command, directory):
+    failures = 0
+    trace_path = os.path.join(directory, 'trace.json')
+
+    for document in ['templates-1_5', 'include-1_6', 'code_snippet-1_1',
+            'quickbook_manual-1_4', 'templates-1_6-fail1']:
+        if os.path.exists(trace_path):
+            os.remove(trace_path)
+        compile(quickbook_command, directory, document,
+            ['--trace-out', trace_path])
+
+        try:
+            with open(trace_path) as f:
+                events = json.load(f)['traceEvents']
+        except (IOError, ValueError, KeyError) as e:
+            print("Invalid trace for %s: %s" % (document, e))
+            failures += 1
+            continue
+
+        error = check_spans(events)
+        if error:
+            print("Invalid trace for %s: %s" % (document, error))
+            failures += 1
+
+    return failures
+
+def check_spans(events):
+    if not events:
+        return "no events"
+    depth = {}
+    last = {}
+    for event in events:
+        thread = (event['pid'], event['tid'])
+        if event['ts'] < last.get(thread, 0):
+            return "time went backwards"
+        last[thread] = event['ts']
+        if event['ph'] == 'B':
+            if not event.get('name'):
+                return "span without a name"
+            depth[thread] = depth.get(thread, 0) + 1
+        elif event['ph'] == 'E':
+            if not depth.get(thread):
+                return "span ended before it started"
+            depth[thread] -= 1
+        else:
+            return "unexpected event type: %s" % event['ph']
+    if any(depth.values()):
+        return "span not ended"
+    return None
+
+# Check the number of calls and maximum depth reported for each template.
+def template_call_counts(quickbook_command, directory):
+    failures = 0
+
+    write_file(os.path.join(directory, 'stats.qbk'),
+        '[article Stats\n[quickbook 1.6]]\n\n'
+        '[import lib.qbk]\n'
+        '[template inner[] inner]\n'
+        '[template outer[x] [inner] [x]]\n'
+        '[template unused[] unused]\n\n'
+        '[outer 1] [outer 2] [inner] [greet]\n')
+    write_file(os.path.join(directory, 'lib.qbk'),
+        '[template greet[] Hello.]\n')
+
+    process = subprocess.Popen([quickbook_command, '--debug',
+            '--template-stats', 'stats.qbk', '--output-file', 'stats.xml'],
+        cwd = directory, stdout = subprocess.PIPE,
+        stderr = subprocess.PIPE, universal_newlines = True)
+    stdout, stderr = process.communicate()
+
+    # Template arguments are expanded as templates, so 'x' is included.
+    expected = {
+        ('outer', 'stats.qbk'): (2, 1),
+        ('inner', 'stats.qbk'): (3, 2),
+        ('x', 'stats.qbk'): (2, 2),
+        ('greet', 'lib.qbk'): (1, 1),
+    }
+
+    lines = stdout.splitlines()
+    try:
+        lines = lines[lines.index('Template statistics, most expensive first:')
+            + 2:]
+    except ValueError:
+        print("No template statistics:")
+        print(stdout)
+        return failures + 1
+
+    found = {}
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 7:
+            break
+        found[(fields[5], fields[6].strip('()'))] = \
+            (int(fields[0]), int(fields[3]))
+
+    if found != expected:
+        print("Wrong template statistics:")
+        print(stdout)
+        failures += 1
+
+    return failures
+
+# Prefetching files shouldn't change the output, or the messages, of
+# documents that include and import other files.
+def prefetched_includes(quickbook_command, directory):
+    failures = 0
+
+    for subdirectory in ['include', 'snippets']:
+        path = os.path.join(test_directory, subdirectory)
+        for document in sorted(os.path.basename(x) for x in
+                glob.glob(os.path.join(path, '*.quickbook'))):
+            expected = compile(quickbook_command, directory, document[:-10],
+                ['-I', 'sub'], path)
+            result = compile(quickbook_command, directory, document[:-10],
+                ['-I', 'sub', '--prefetch'], path)
+            if result != expected:
+                print("Different result for %s with --prefetch." %
+                    os.path.join(subdirectory, document))
+                failures += 1
+
+    return failures
+
+def compile(quickbook_command, directory, document, args,
+        cwd = test_directory):
+    output_path = os.path.join(directory, 'output.xml')
+    process = subprocess.Popen([quickbook_command, '--debug',
+            document + '.quickbook', '--output-file', output_path] + args,
+        cwd = cwd, stdout = subprocess.PIPE,
+        stderr = subprocess.PIPE, universal_newlines = True)
+    stdout, stderr = process.communicate()
+    # No output is written when there's an error.
+    if not os.path.exists(output_path):
+        return stdout, stderr, None
+    output = read_file(output_path)
+    os.remove(output_path)
+    return stdout, stderr, output
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename, 'rb') as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
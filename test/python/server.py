@@ -0,0 +1,96 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests for the compile server. Run with the path to quickbook, e.g.
+#
+#     python server.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil, time, socket, struct
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: server.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    directory = tempfile.mkdtemp()
+    try:
+        failures = same_names(quickbook_command, directory)
+    finally:
+        shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# Compile files with the same name, size and modification time from two
+# different directories. The server mustn't mix up the cached files, or be
+# stopped by invalid requests.
+def same_names(quickbook_command, directory):
+    failures = 0
+    socket_path = os.path.join(directory, 'server.sock')
+    stamp = time.time() - 60
+
+    for name in ['a', 'b']:
+        os.mkdir(os.path.join(directory, name))
+        write_file(os.path.join(directory, name, 'doc.qbk'),
+            '[article %s\n[quickbook 1.5]]\n\n'
+            'Hello %s.\n\n[include inc.qbk]\n' % (name.upper(), name * 3))
+        write_file(os.path.join(directory, name, 'inc.qbk'),
+            'Included from %s.\n' % name)
+        for filename in ['doc.qbk', 'inc.qbk']:
+            os.utime(os.path.join(directory, name, filename), (stamp, stamp))
+
+    server = subprocess.Popen([quickbook_command, '--server', socket_path],
+        stdout = subprocess.PIPE)
+    try:
+        # Wait for the server to start listening.
+        server.stdout.readline()
+
+        # Requests that are too large should be rejected, without stopping
+        # the server.
+        for message in [struct.pack('>I', 0xffffffff),
+                struct.pack('>II', 2, 0xffffffff)]:
+            client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            client.connect(socket_path)
+            client.sendall(message)
+            client.close()
+
+        for name in ['a', 'b', 'a']:
+            exit_code = subprocess.call(
+                [quickbook_command, '--client', socket_path, 'doc.qbk',
+                    '--output-file', 'doc.xml'],
+                cwd = os.path.join(directory, name))
+            output = read_file(os.path.join(directory, name, 'doc.xml'))
+
+            if exit_code != 0:
+                print("Error compiling in %s." % name)
+                failures += 1
+            elif ('<title>%s</title>' % name.upper()) not in output or \
+                    ('Hello %s.' % (name * 3)) not in output or \
+                    ('Included from %s.' % name) not in output:
+                print("Wrong output in %s:" % name)
+                print(output)
+                failures += 1
+    finally:
+        subprocess.call([quickbook_command, '--client', socket_path,
+            '--stop-server'])
+        server.wait()
+
+    return failures
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename) as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
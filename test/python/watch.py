@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+
+# Copyright 2026 Daniel James
+# Distributed under the Boost Software License, Version 1.0.
+# (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
+
+# Tests for rebuilding a document with --watch. Run with the path to
+# quickbook, e.g.
+#
+#     python watch.py ../../dist/bin/quickbook
+
+import sys, os, subprocess, tempfile, shutil, threading, time
+
+try:
+    import queue
+except ImportError:
+    import Queue as queue
+
+def main(args):
+    if len(args) != 1:
+        print("Usage: watch.py quickbook-command")
+        exit(1)
+    quickbook_command = os.path.abspath(args[0])
+
+    if not sys.platform.startswith('linux'):
+        print("--watch is only available on linux.")
+        return
+
+    directory = tempfile.mkdtemp()
+    try:
+        failures = rebuild_on_change(quickbook_command, directory)
+    finally:
+        shutil.rmtree(directory)
+
+    if failures == 0:
+        print("Success")
+    else:
+        print("Failures: %d" % failures)
+        exit(failures)
+
+# Make a series of changes to a document and its dependencies, checking
+# that it's rebuilt after each one.
+def rebuild_on_change(quickbook_command, directory):
+    failures = 0
+    output_path = os.path.join(directory, 'doc.xml')
+
+    write_file(os.path.join(directory, 'doc.qbk'),
+        '[article Doc\n[quickbook 1.5]]\n\n'
+        'Main text.\n\n[include inc.qbk]\n\n[include extra.qbk]\n')
+    write_file(os.path.join(directory, 'inc.qbk'), 'Included text.\n')
+    os.mkdir(os.path.join(directory, 'include'))
+    write_file(os.path.join(directory, 'include', 'extra.qbk'),
+        'Found in the include path.\n')
+
+    # Each change, and the text expected in the output afterwards, or None
+    # if the rebuild should fail.
+    edits = [
+        ('document', 'doc.qbk', 'Main text.', 'Changed text.',
+            ['Changed text.', 'Included text.']),
+        ('included file', 'inc.qbk', 'Included', 'Edited',
+            ['Changed text.', 'Edited text.']),
+        ('error', 'doc.qbk', 'Changed text.', '[endsect]', None),
+        ('fixed error', 'doc.qbk', '[endsect]', 'Fixed text.',
+            ['Fixed text.', 'Edited text.', 'Found in the include path.']),
+        # 'extra.qbk' is found in the include path, until one is added
+        # next to the document.
+        ('added file', 'extra.qbk', None, 'Found locally.\n',
+            ['Fixed text.', 'Found locally.']),
+    ]
+
+    process = subprocess.Popen([quickbook_command, '--debug', '--watch',
+            'doc.qbk', '--output-file', output_path, '-I', 'include'],
+        cwd = directory, stdout = subprocess.PIPE, stderr = subprocess.PIPE,
+        universal_newlines = True)
+    lines = read_lines(process.stdout)
+    read_lines(process.stderr)
+
+    try:
+        if not wait_for(lines, 'Watching '):
+            print("Initial build didn't finish.")
+            return 1
+
+        if not check_output(output_path, ['Main text.', 'Included text.',
+                'Found in the include path.']):
+            failures += 1
+
+        for name, filename, old, new, expected in edits:
+            # Each edit changes the file's size, so that it's noticed even
+            # where modification times are coarse.
+            path = os.path.join(directory, filename)
+            if old:
+                write_file(path, read_file(path).replace(old, new))
+            else:
+                write_file(path, new)
+
+            result = wait_for(lines, ('Rebuilt in', 'Rebuild failed'))
+            if not result:
+                print("No rebuild after '%s'." % name)
+                failures += 1
+                break
+            if result.startswith('Rebuilt') != bool(expected):
+                print("Unexpected result after '%s': %s" % (name, result))
+                failures += 1
+            if not wait_for(lines, 'Watching '):
+                print("Stopped watching after '%s'." % name)
+                failures += 1
+                break
+
+            if expected and not check_output(output_path, expected):
+                print("Wrong output after '%s'." % name)
+                failures += 1
+    finally:
+        process.kill()
+        process.wait()
+
+    return failures
+
+# Read lines from a pipe in the background, so that waiting for them can
+# time out.
+def read_lines(pipe):
+    lines = queue.Queue()
+    def read():
+        for line in iter(pipe.readline, ''):
+            lines.put(line)
+    thread = threading.Thread(target = read)
+    thread.daemon = True
+    thread.start()
+    return lines
+
+def wait_for(lines, prefix, timeout = 10):
+    end = time.time() + timeout
+    while True:
+        remaining = end - time.time()
+        if remaining <= 0:
+            return None
+        try:
+            line = lines.get(timeout = remaining)
+        except queue.Empty:
+            return None
+        if line.startswith(prefix):
+            return line.strip()
+
+def check_output(output_path, expected):
+    output = read_file(output_path)
+    for text in expected:
+        if text not in output:
+            print("'%s' not found in output:" % text)
+            print(output)
+            return False
+    return True
+
+def write_file(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def read_file(filename):
+    with open(filename) as f:
+        return f.read()
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
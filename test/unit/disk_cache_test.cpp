@@ -0,0 +1,126 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "disk_cache.hpp"
+#include "version.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <iterator>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    fs::path directory;
+
+    std::string read_entry(std::string const& key)
+    {
+        fs::ifstream in(directory / key, std::ios_base::binary);
+        return std::string(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+    }
+
+    void write_entry(std::string const& key, std::string const& entry)
+    {
+        fs::ofstream out(directory / key, std::ios_base::binary);
+        out << entry;
+    }
+
+    bool cached(std::string const& key, boost::string_ref content,
+            std::string& data)
+    {
+        boost::string_ref result;
+        boost::shared_ptr<void> entry =
+            quickbook::read_cache_entry(key, content, result);
+        if (entry) data.assign(result.begin(), result.end());
+        return !!entry;
+    }
+
+    void replace(std::string& x, std::string const& old,
+            std::string const& replacement)
+    {
+        std::string::size_type pos = x.find(old);
+        BOOST_TEST(pos != std::string::npos);
+        if (pos != std::string::npos)
+            x.replace(pos, old.size(), replacement);
+    }
+}
+
+void round_trip_tests()
+{
+    std::string key = quickbook::cache_key("test", "content");
+    std::string data;
+
+    BOOST_TEST(!cached(key, "content", data));
+    quickbook::write_cache_entry(key, "content", "data");
+    BOOST_TEST(cached(key, "content", data));
+    BOOST_TEST_EQ(data, "data");
+
+    // Different content with the same key, as if the hash collided.
+    BOOST_TEST(!cached(key, "other", data));
+
+    BOOST_TEST(quickbook::cache_key("test", "content") == key);
+    BOOST_TEST(quickbook::cache_key("test", "other") != key);
+    BOOST_TEST(quickbook::cache_key("other", "content") != key);
+    BOOST_TEST(quickbook::cache_key("test", "content", "106") != key);
+}
+
+// Entries written by another version of quickbook, or with another
+// format, are ignored.
+void version_tests()
+{
+    std::string key = quickbook::cache_key("version", "content");
+    quickbook::write_cache_entry(key, "content", "data");
+    std::string entry = read_entry(key);
+    std::string data;
+
+    std::string version(QUICKBOOK_VERSION);
+    std::string other_version(version);
+    other_version[other_version.size() - 1] ^= 1;
+
+    std::string changed = entry;
+    replace(changed, version, other_version);
+    write_entry(key, changed);
+    BOOST_TEST(!cached(key, "content", data));
+
+    // A longer version, in case the lengths are compared but not the
+    // contents.
+    changed = entry;
+    replace(changed, version, version + "0");
+    write_entry(key, changed);
+    BOOST_TEST(!cached(key, "content", data));
+
+    changed = entry;
+    replace(changed, "QBKCACHE", "QBKCACHF");
+    write_entry(key, changed);
+    BOOST_TEST(!cached(key, "content", data));
+
+    // Truncated.
+    write_entry(key, entry.substr(0, entry.size() - 1));
+    BOOST_TEST(!cached(key, "content", data));
+
+    write_entry(key, entry);
+    BOOST_TEST(cached(key, "content", data));
+    BOOST_TEST_EQ(data, "data");
+}
+
+int main()
+{
+    directory = fs::temp_directory_path() /
+        fs::unique_path("quickbook-disk-cache-%%%%-%%%%-%%%%");
+    fs::create_directory(directory);
+    quickbook::set_cache_dir(directory);
+
+    round_trip_tests();
+    version_tests();
+
+    fs::remove_all(directory);
+    return boost::report_errors();
+}
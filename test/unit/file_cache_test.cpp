@@ -0,0 +1,163 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "files.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    fs::path directory;
+
+    fs::path write_file(char const* name, std::string const& contents)
+    {
+        fs::path path = directory / name;
+        fs::ofstream out(path, std::ios_base::binary);
+        out << contents;
+        return path;
+    }
+
+    // Each file is 100 bytes.
+    std::string const contents(100, 'x');
+}
+
+void eviction_tests()
+{
+    fs::path a = write_file("a.qbk", contents);
+    fs::path b = write_file("b.qbk", contents);
+    fs::path c = write_file("c.qbk", contents);
+
+    quickbook::set_file_cache_size(250);
+
+    // 'a' is kept in use, so it can't be evicted.
+    quickbook::file_ptr held = quickbook::load(a);
+    quickbook::load(b);
+    quickbook::load(c);
+
+    // Loading 'c' went over the limit, 'b' is the oldest file not in use.
+    quickbook::file_cache_stats stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.misses, 3u);
+    BOOST_TEST_EQ(stats.hits, 0u);
+    BOOST_TEST_EQ(stats.evictions, 1u);
+    BOOST_TEST_EQ(stats.files, 2u);
+    BOOST_TEST_EQ(stats.bytes, 200u);
+
+    quickbook::load(c);
+    quickbook::load(a);
+    stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.hits, 2u);
+    BOOST_TEST_EQ(stats.misses, 3u);
+
+    // Reloading 'b' evicts 'c', rather than the file being loaded, or the
+    // held file, even though it's the least recently used.
+    quickbook::load(c);
+    quickbook::load(b);
+    stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.hits, 3u);
+    BOOST_TEST_EQ(stats.misses, 4u);
+    BOOST_TEST_EQ(stats.evictions, 2u);
+    BOOST_TEST_EQ(stats.files, 2u);
+    BOOST_TEST_EQ(stats.bytes, 200u);
+
+    quickbook::load(a);
+    BOOST_TEST_EQ(quickbook::get_file_cache_stats().hits, 4u);
+    quickbook::load(c);
+    BOOST_TEST_EQ(quickbook::get_file_cache_stats().misses, 5u);
+
+    // Shrinking the cache only keeps the held file.
+    quickbook::set_file_cache_size(0);
+    stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.evictions, 4u);
+    BOOST_TEST_EQ(stats.files, 1u);
+    BOOST_TEST_EQ(stats.bytes, 100u);
+
+    // Once it's released, it's evicted the next time the cache is checked.
+    held = 0;
+    quickbook::set_file_cache_size(0);
+    stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.evictions, 5u);
+    BOOST_TEST_EQ(stats.files, 0u);
+    BOOST_TEST_EQ(stats.bytes, 0u);
+}
+
+void data_tests()
+{
+    fs::path a = write_file("data_a.qbk", contents);
+    fs::path b = write_file("data_b.qbk", contents);
+
+    quickbook::set_file_cache_size(1000);
+    quickbook::file_cache_stats start = quickbook::get_file_cache_stats();
+
+    quickbook::file_ptr fa = quickbook::load(a);
+    quickbook::file_ptr fb = quickbook::load(b);
+
+    boost::shared_ptr<void const> data(new int(1));
+    quickbook::set_file_cache_data(fa, "key", data, 50);
+    BOOST_TEST(quickbook::get_file_cache_data(fa, "key") == data);
+    BOOST_TEST(!quickbook::get_file_cache_data(fa, "other"));
+    BOOST_TEST(!quickbook::get_file_cache_data(fb, "key"));
+
+    // Another load of the same file shares its data.
+    BOOST_TEST(quickbook::get_file_cache_data(quickbook::load(a), "key") ==
+        data);
+
+    // The data counts against the cache's size.
+    quickbook::file_cache_stats stats = quickbook::get_file_cache_stats();
+    BOOST_TEST_EQ(stats.bytes, start.bytes + 250);
+
+    // Data is only set once.
+    quickbook::set_file_cache_data(fa, "key",
+        boost::shared_ptr<void const>(new int(2)), 50);
+    BOOST_TEST(quickbook::get_file_cache_data(fa, "key") == data);
+    BOOST_TEST_EQ(quickbook::get_file_cache_stats().bytes, start.bytes + 250);
+
+    // When the cache is too full, the data is dropped from the least
+    // recently used file, even though the file is still in use.
+    quickbook::set_file_cache_size(200);
+    stats = quickbook::get_file_cache_stats();
+    BOOST_TEST(!quickbook::get_file_cache_data(fa, "key"));
+    BOOST_TEST_EQ(stats.bytes, start.bytes + 200);
+    BOOST_TEST_EQ(stats.evictions, start.evictions);
+
+    // A reloaded file has no data.
+    quickbook::set_file_cache_size(1000);
+    quickbook::set_file_cache_data(fb, "key", data, 10);
+    BOOST_TEST(quickbook::get_file_cache_data(fb, "key") == data);
+    fb = 0;
+    write_file("data_b.qbk", contents + "changed");
+    quickbook::check_loaded_files();
+    fb = quickbook::load(b);
+    BOOST_TEST(!quickbook::get_file_cache_data(fb, "key"));
+    BOOST_TEST_EQ(fb->source().size(), 107u);
+
+    fa = 0;
+    fb = 0;
+    quickbook::set_file_cache_size(0);
+    BOOST_TEST_EQ(quickbook::get_file_cache_stats().bytes, 0u);
+}
+
+int main()
+{
+    directory = fs::temp_directory_path() /
+        fs::unique_path("quickbook-file-cache-%%%%-%%%%-%%%%");
+    fs::create_directory(directory);
+
+    // Memory mapped files can't be overwritten on some systems.
+    quickbook::use_memory_mapped_files(false);
+
+    eviction_tests();
+    data_tests();
+
+    fs::remove_all(directory);
+    return boost::report_errors();
+}
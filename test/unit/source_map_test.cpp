@@ -8,9 +8,43 @@
 
 #include "fwd.hpp"
 #include "files.hpp"
+#include "disk_cache.hpp"
 #include <boost/utility/string_ref.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <boost/range/algorithm/find.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <vector>
+
+void position_tests()
+{
+    boost::string_ref source("One\n\nThree\r\nFour\rFive\n");
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", source, 105u);
+    quickbook::string_iterator begin = fake_file->source().begin();
+
+    BOOST_TEST_EQ(fake_file->position_of(begin),
+        quickbook::file_position(1,1));
+    BOOST_TEST_EQ(fake_file->position_of(begin + 3),
+        quickbook::file_position(1,4));
+    BOOST_TEST_EQ(fake_file->position_of(begin + 4),
+        quickbook::file_position(2,1));
+    BOOST_TEST_EQ(fake_file->position_of(begin + 7),
+        quickbook::file_position(3,3));
+    BOOST_TEST_EQ(fake_file->position_of(begin + 12),
+        quickbook::file_position(4,1));
+    BOOST_TEST_EQ(fake_file->position_of(begin + 17),
+        quickbook::file_position(5,1));
+    BOOST_TEST_EQ(fake_file->position_of(fake_file->source().end()),
+        quickbook::file_position(6,1));
+
+    // A file sharing the source gives the same positions.
+    quickbook::file_ptr shared = new quickbook::file(
+        fake_file->path, fake_file, 106u);
+    BOOST_TEST_EQ(shared->position_of(shared->source().begin() + 7),
+        quickbook::file_position(3,3));
+}
 
 void simple_map_tests()
 {
@@ -382,14 +416,331 @@ void indented_map_mixed_test()
     }
 }
 
+void indented_map_large_test()
+{
+    // A block with a lot of lines, some blank, some more indented.
+    std::string source;
+    std::vector<int> line_indent;
+    for (int i = 0; i < 5000; ++i) {
+        int indent = i % 7 == 3 ? -1 : 4 + (i % 5 == 0 ? 2 : 0);
+        line_indent.push_back(indent);
+        if (indent >= 0) {
+            source.append(indent, ' ');
+            source += "Line ";
+            source += boost::lexical_cast<std::string>(i + 1);
+        }
+        source += '\n';
+    }
+
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", source, 105u);
+
+    quickbook::mapped_file_builder builder;
+    builder.start(fake_file);
+    builder.unindent_and_add(fake_file->source());
+    quickbook::file_ptr f1 = builder.release();
+
+    boost::string_ref result = f1->source();
+    quickbook::string_iterator it = result.begin();
+    for (int i = 0; i < 5000; ++i) {
+        if (line_indent[i] >= 0) {
+            // The start of the text, and a character in the middle.
+            BOOST_TEST_EQ(f1->position_of(it + line_indent[i] - 4),
+                quickbook::file_position(i + 1, line_indent[i] + 1));
+            BOOST_TEST_EQ(f1->position_of(it + line_indent[i] - 4 + 3),
+                quickbook::file_position(i + 1, line_indent[i] + 4));
+        }
+        it = std::find(it, result.end(), '\n');
+        BOOST_TEST(it != result.end());
+        BOOST_TEST_EQ(f1->position_of(it).line, i + 1);
+        ++it;
+    }
+    BOOST_TEST(it == result.end());
+
+    // Part of the block, copied from the middle of a line.
+    {
+        std::string const text(result.begin(), result.end());
+        quickbook::mapped_file_builder builder2;
+        builder2.start(fake_file);
+        builder2.unindent_and_add(fake_file->source());
+
+        boost::string_ref::size_type line_10 = 0;
+        for (int i = 0; i < 9; ++i)
+            line_10 = text.find('\n', line_10) + 1;
+
+        builder.start(fake_file);
+        builder.add(builder2, line_10 + 2, result.size() - 100);
+        quickbook::file_ptr f2 = builder.release();
+
+        BOOST_TEST_EQ(f2->source(), result.substr(line_10 + 2,
+            result.size() - 100 - line_10 - 2));
+        BOOST_TEST_EQ(f2->position_of(f2->source().begin()),
+            quickbook::file_position(10, 7));
+
+        boost::string_ref::size_type line_4000 =
+            text.find("Line 4000\n") - line_10 - 2;
+        BOOST_TEST_EQ(f2->position_of(f2->source().begin() + line_4000),
+            quickbook::file_position(4000, 5));
+        BOOST_TEST_EQ(f2->position_of(f2->source().begin() + line_4000 + 9),
+            quickbook::file_position(4000, 14));
+    }
+}
+
+void indented_map_leading_blanks_position_test()
+{
+    boost::string_ref source("\n\n   Code line1\n     Code line2\n");
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", source, 105u);
+
+    quickbook::mapped_file_builder builder;
+    builder.start(fake_file);
+    builder.unindent_and_add(fake_file->source());
+    quickbook::file_ptr f1 = builder.release();
+
+    BOOST_TEST_EQ(f1->source(),
+        boost::string_ref("Code line1\n  Code line2\n"));
+    BOOST_TEST_EQ(f1->position_of(f1->source().begin()),
+        quickbook::file_position(3,4));
+    BOOST_TEST_EQ(f1->position_of(f1->source().begin() + 11),
+        quickbook::file_position(4,1));
+    BOOST_TEST_EQ(f1->position_of(f1->source().begin() + 13),
+        quickbook::file_position(4,6));
+}
+
+void shared_text_test()
+{
+    boost::string_ref source("   Code line1\n   Code line2\n");
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", source, 105u);
+
+    quickbook::mapped_file_builder builder;
+
+    { // A single large span of the original isn't copied.
+        std::string long_source = "\n  " + std::string(1000, 'x');
+        quickbook::file_ptr long_file = new quickbook::file(
+            "(fake file)", long_source, 105u);
+
+        builder.start(long_file);
+        builder.add(boost::string_ref(long_file->source().begin() + 3, 900));
+        quickbook::file_ptr f1 = builder.release();
+        BOOST_TEST_EQ(f1->source(), boost::string_ref(std::string(900, 'x')));
+        BOOST_TEST(f1->source().begin() == long_file->source().begin() + 3);
+        BOOST_TEST_EQ(f1->position_of(f1->source().begin() + 5),
+            quickbook::file_position(2,8));
+    }
+
+    { // Text is still available after the builder it came from is gone.
+        builder.start(fake_file);
+        {
+            quickbook::mapped_file_builder builder2;
+            builder2.start(fake_file);
+            builder2.add_at_pos("Before\n", fake_file->source().begin());
+            builder2.unindent_and_add(fake_file->source());
+            builder.add(builder2, 7, builder2.get_pos());
+        }
+        quickbook::file_ptr f1 = builder.release();
+        BOOST_TEST_EQ(f1->source(),
+            boost::string_ref("Code line1\nCode line2\n"));
+        BOOST_TEST_EQ(f1->position_of(f1->source().begin() + 11),
+            quickbook::file_position(2,4));
+    }
+}
+
+namespace
+{
+    // Write a mapped file in the disk cache's format, and read it back.
+    quickbook::file_ptr cache_round_trip(quickbook::file_ptr const& f,
+            quickbook::file_ptr const& original)
+    {
+        boost::shared_ptr<std::string> data(new std::string());
+        quickbook::write_mapped_file(*data, f);
+        boost::string_ref in(*data);
+        quickbook::file_ptr result =
+            quickbook::read_mapped_file(in, original, data);
+        BOOST_TEST(in.empty());
+        return result;
+    }
+
+    struct cache_section
+    {
+        unsigned original_pos, our_pos, section_type;
+    };
+
+    // Read a mapped file from data written by hand. Section types are 0
+    // for normal, 1 for empty and 2 for indented.
+    quickbook::file_ptr read_cache_data(quickbook::file_ptr const& original,
+            boost::string_ref text,
+            std::vector<cache_section> const& sections,
+            std::vector<cache_section> const& lines)
+    {
+        boost::shared_ptr<std::string> data(new std::string());
+        quickbook::write_cache_string(*data, text);
+        quickbook::write_cache_int(*data, sections.size());
+        for (std::size_t i = 0; i < sections.size(); ++i) {
+            quickbook::write_cache_int(*data, sections[i].original_pos);
+            quickbook::write_cache_int(*data, sections[i].our_pos);
+            quickbook::write_cache_int(*data, sections[i].section_type);
+        }
+        quickbook::write_cache_int(*data, lines.size());
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            quickbook::write_cache_int(*data, lines[i].original_pos);
+            quickbook::write_cache_int(*data, lines[i].our_pos);
+        }
+        boost::string_ref in(*data);
+        return quickbook::read_mapped_file(in, original, data);
+    }
+
+    std::vector<cache_section> sections(cache_section const* begin,
+            cache_section const* end)
+    {
+        return std::vector<cache_section>(begin, end);
+    }
+}
+
+void cache_round_trip_tests()
+{
+    boost::string_ref source(
+        "Some text.\n"
+        "    Code line1\n"
+        "      Code line2\n"
+        "\n"
+        "    Code line3\n"
+        "More text.\n");
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", source, 105u);
+    quickbook::string_iterator begin = fake_file->source().begin();
+
+    // A file with every kind of section: normal, empty and indented, and
+    // part of it copied into another.
+    quickbook::mapped_file_builder builder;
+    builder.start(fake_file);
+    builder.add(boost::string_ref(begin, 11));
+    builder.add_at_pos("Inserted\n", begin + 11);
+    builder.unindent_and_add(boost::string_ref(begin + 11, 48));
+    builder.add(boost::string_ref(begin + 59, 11));
+
+    quickbook::mapped_file_builder builder2;
+    builder2.start(fake_file);
+    builder2.add(boost::string_ref(begin + 59, 5));
+    builder2.add(builder, 5, builder.get_pos() - 3);
+
+    quickbook::file_ptr files[] = { builder.release(), builder2.release() };
+
+    for (std::size_t i = 0; i < sizeof(files) / sizeof(*files); ++i)
+    {
+        quickbook::file_ptr const& f = files[i];
+        quickbook::file_ptr f2 = cache_round_trip(f, fake_file);
+        BOOST_TEST(f2);
+        if (!f2) continue;
+
+        BOOST_TEST_EQ(f2->source(), f->source());
+        for (std::size_t pos = 0; pos <= f->source().size(); ++pos)
+        {
+            BOOST_TEST_EQ(f2->position_of(f2->source().begin() + pos),
+                f->position_of(f->source().begin() + pos));
+        }
+
+        // The positions map to a different load of the same file.
+        quickbook::file_ptr reloaded = new quickbook::file(
+            "(reloaded)", fake_file, 105u);
+        quickbook::file_ptr f3 = cache_round_trip(f, reloaded);
+        BOOST_TEST(f3);
+        if (f3) {
+            BOOST_TEST_EQ(f3->position_of(f3->source().begin() + 3),
+                f->position_of(f->source().begin() + 3));
+        }
+    }
+
+    { // An empty file.
+        quickbook::mapped_file_builder builder3;
+        builder3.start(fake_file);
+        quickbook::file_ptr f = cache_round_trip(builder3.release(), fake_file);
+        BOOST_TEST(f && f->source().empty());
+    }
+}
+
+void invalid_cache_tests()
+{
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "(fake file)", boost::string_ref("abcdef\n  ghi\n"), 105u);
+    std::vector<cache_section> none;
+
+    { // Valid data, to check that the others are rejected for the
+      // right reason.
+        cache_section s[] = { {0, 0, 0}, {6, 3, 1}, {9, 4, 2} };
+        cache_section l[] = { {7, 4, 0} };
+        BOOST_TEST(read_cache_data(fake_file, "abc\nghi",
+            sections(s, s + 3), sections(l, l + 1)));
+    }
+
+    { // Position out of range.
+        cache_section s[] = { {0, 0, 0}, {20, 3, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "abcdef",
+            sections(s, s + 2), none));
+    }
+
+    { // The first section doesn't start at the beginning.
+        cache_section s[] = { {0, 1, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "abc", sections(s, s + 1),
+            none));
+        BOOST_TEST(!read_cache_data(fake_file, "abc", none, none));
+    }
+
+    { // Sections out of order.
+        cache_section s[] = { {0, 0, 0}, {3, 4, 0}, {2, 2, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "abcdef",
+            sections(s, s + 3), none));
+    }
+
+    { // A normal section that runs past the end of the original.
+        cache_section s[] = { {10, 0, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "abcdefghij",
+            sections(s, s + 1), none));
+    }
+
+    { // An indented section without any lines.
+        cache_section s[] = { {0, 0, 0}, {9, 4, 2} };
+        BOOST_TEST(!read_cache_data(fake_file, "abc\nghi",
+            sections(s, s + 2), none));
+    }
+
+    { // An indented section that doesn't start with a line.
+        cache_section s[] = { {0, 0, 0}, {9, 4, 2} };
+        cache_section l[] = { {9, 5, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "abc\nghi",
+            sections(s, s + 2), sections(l, l + 1)));
+    }
+
+    { // Lines out of order.
+        cache_section s[] = { {7, 0, 2} };
+        cache_section l[] = { {7, 0, 0}, {9, 3, 0}, {8, 2, 0} };
+        BOOST_TEST(!read_cache_data(fake_file, "ghi\njk",
+            sections(s, s + 1), sections(l, l + 3)));
+    }
+
+    { // Truncated data.
+        boost::shared_ptr<std::string> data(new std::string());
+        quickbook::write_cache_string(*data, "abc");
+        quickbook::write_cache_int(*data, 1);
+        quickbook::write_cache_int(*data, 0);
+        boost::string_ref in(*data);
+        BOOST_TEST(!quickbook::read_mapped_file(in, fake_file, data));
+    }
+}
 
 int main()
 {
+    position_tests();
     simple_map_tests();
     indented_map_tests();
     indented_map_tests2();
     indented_map_leading_blanks_test();
     indented_map_trailing_blanks_test();
     indented_map_mixed_test();
+    indented_map_large_test();
+    indented_map_leading_blanks_position_test();
+    shared_text_test();
+    cache_round_trip_tests();
+    invalid_cache_tests();
     return boost::report_errors();
 }
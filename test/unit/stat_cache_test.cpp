@@ -0,0 +1,134 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "stat_cache.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/detail/lightweight_test.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    fs::path directory;
+
+    void write_file(fs::path const& path)
+    {
+        fs::ofstream out(path);
+        out << "Some text.\n";
+    }
+
+    // The number of system calls made by a lookup.
+    template <typename F>
+    boost::uintmax_t system_calls(F f)
+    {
+        boost::uintmax_t start =
+            quickbook::get_stat_cache_stats().system_calls;
+        f();
+        return quickbook::get_stat_cache_stats().system_calls - start;
+    }
+
+    struct lookup
+    {
+        explicit lookup(fs::path const& p) : p(p) {}
+        fs::path p;
+
+        void operator()() const { quickbook::cached_status(p); }
+    };
+
+    using quickbook::cached_exists;
+}
+
+void missing_file_tests()
+{
+    fs::path dir = directory / "missing";
+    fs::create_directory(dir);
+    write_file(dir / "present.qbk");
+    fs::create_directory(dir / "sub");
+
+    // The first missing file lists the directory.
+    BOOST_TEST_EQ(system_calls(lookup(dir / "missing1.qbk")), 2u);
+    BOOST_TEST(!cached_exists(dir / "missing1.qbk"));
+
+    // Then other missing files are found from the listing.
+    BOOST_TEST_EQ(system_calls(lookup(dir / "missing2.qbk")), 0u);
+    BOOST_TEST(!cached_exists(dir / "missing2.qbk"));
+
+    // Files in the listing are still checked.
+    BOOST_TEST_EQ(system_calls(lookup(dir / "present.qbk")), 1u);
+    BOOST_TEST(cached_exists(dir / "present.qbk"));
+    BOOST_TEST(quickbook::cached_is_regular_file(dir / "present.qbk"));
+    BOOST_TEST_EQ(system_calls(lookup(dir / "sub")), 1u);
+    BOOST_TEST(fs::is_directory(quickbook::cached_status(dir / "sub")));
+
+    // Repeated lookups are cached.
+    BOOST_TEST_EQ(system_calls(lookup(dir / "present.qbk")), 0u);
+    BOOST_TEST_EQ(system_calls(lookup(dir / "missing1.qbk")), 0u);
+
+    // "." and ".." aren't in the listing.
+    BOOST_TEST(cached_exists(dir / "."));
+    BOOST_TEST(cached_exists(dir / ".."));
+    BOOST_TEST(cached_exists(dir / "sub" / ".."));
+
+    // A file added after the directory was listed isn't seen until the
+    // cache is cleared.
+    write_file(dir / "added.qbk");
+    BOOST_TEST(!cached_exists(dir / "added.qbk"));
+    quickbook::clear_stat_cache();
+    BOOST_TEST(cached_exists(dir / "added.qbk"));
+
+    // Every file in a directory which doesn't exist is missing.
+    BOOST_TEST_EQ(system_calls(lookup(dir / "none" / "a.qbk")), 2u);
+    BOOST_TEST_EQ(system_calls(lookup(dir / "none" / "b.qbk")), 0u);
+    BOOST_TEST(!cached_exists(dir / "none" / "b.qbk"));
+}
+
+// On a case insensitive file system, a file can be found using a name with
+// different case, so a name that matches a file in the listing ignoring
+// case has to be checked. Whatever the file system, the result has to be
+// the same as looking it up directly.
+void case_tests()
+{
+    fs::path dir = directory / "case";
+    fs::create_directory(dir);
+    write_file(dir / "Upper.qbk");
+    // 'Ée.qbk' in UTF-8.
+    fs::path non_ascii("\xc3\x89" "e.qbk");
+    write_file(dir / non_ascii);
+
+    BOOST_TEST(!cached_exists(dir / "missing.qbk"));
+
+    BOOST_TEST_EQ(system_calls(lookup(dir / "upper.qbk")), 1u);
+    BOOST_TEST_EQ(cached_exists(dir / "upper.qbk"),
+        fs::exists(dir / "upper.qbk"));
+    BOOST_TEST_EQ(system_calls(lookup(dir / "UPPER.QBK")), 1u);
+    BOOST_TEST_EQ(cached_exists(dir / "UPPER.QBK"),
+        fs::exists(dir / "UPPER.QBK"));
+    BOOST_TEST(cached_exists(dir / "Upper.qbk"));
+
+    // Case is only folded for ASCII, so other names are always checked.
+    fs::path lower("\xc3\xa9" "e.qbk");
+    BOOST_TEST_EQ(system_calls(lookup(dir / lower)), 1u);
+    BOOST_TEST_EQ(cached_exists(dir / lower), fs::exists(dir / lower));
+    BOOST_TEST_EQ(system_calls(lookup(dir / "\xc3\xa9" "f.qbk")), 1u);
+    BOOST_TEST(!cached_exists(dir / "\xc3\xa9" "f.qbk"));
+    BOOST_TEST(cached_exists(dir / non_ascii));
+}
+
+int main()
+{
+    directory = fs::temp_directory_path() /
+        fs::unique_path("quickbook-stat-cache-%%%%-%%%%-%%%%");
+    fs::create_directory(directory);
+
+    missing_file_tests();
+    case_tests();
+
+    fs::remove_all(directory);
+    return boost::report_errors();
+}
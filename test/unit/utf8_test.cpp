@@ -0,0 +1,76 @@
+/*=============================================================================
+    Copyright (c) 2026 Daniel James
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "files.hpp"
+#include <boost/utility/string_ref.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <string>
+
+namespace
+{
+    std::string::size_type check(boost::string_ref x)
+    {
+        bool has_cr = false;
+        return quickbook::check_utf8(x, has_cr);
+    }
+
+    bool has_cr(boost::string_ref x)
+    {
+        bool has_cr = false;
+        quickbook::check_utf8(x, has_cr);
+        return has_cr;
+    }
+
+    std::string::size_type const valid = std::string::npos;
+}
+
+void valid_tests()
+{
+    BOOST_TEST_EQ(check(""), valid);
+    BOOST_TEST_EQ(check("Plain ASCII text, long enough for a few words."),
+        valid);
+    BOOST_TEST_EQ(check("\xc3\xa9"), valid);
+    BOOST_TEST_EQ(check("\xe2\x82\xac and \xf0\x9f\x98\x80"), valid);
+    BOOST_TEST_EQ(check("\xed\x9f\xbf"), valid);            // U+D7FF
+    BOOST_TEST_EQ(check("\xee\x80\x80"), valid);            // U+E000
+    BOOST_TEST_EQ(check("\xf4\x8f\xbf\xbf"), valid);        // U+10FFFF
+    BOOST_TEST_EQ(check("12345678\xce\xb1\xce\xb2" "12345678"), valid);
+}
+
+void invalid_tests()
+{
+    BOOST_TEST_EQ(check("\x80"), 0u);                       // Continuation
+    BOOST_TEST_EQ(check("caf\xe9."), 3u);                   // Latin-1
+    BOOST_TEST_EQ(check("\xc0\xaf"), 0u);                   // Overlong
+    BOOST_TEST_EQ(check("\xe0\x80\xaf"), 0u);               // Overlong
+    BOOST_TEST_EQ(check("\xf0\x80\x80\xaf"), 0u);           // Overlong
+    BOOST_TEST_EQ(check("\xed\xa0\x80"), 0u);               // Surrogate
+    BOOST_TEST_EQ(check("\xf4\x90\x80\x80"), 0u);           // Too large
+    BOOST_TEST_EQ(check("\xf5\x80\x80\x80"), 0u);
+    BOOST_TEST_EQ(check("ab\xe2\x82"), 2u);                 // Truncated
+    BOOST_TEST_EQ(check("ab\xe2\x82z"), 2u);
+    BOOST_TEST_EQ(check("0123456789abcdef\xff"), 16u);
+    BOOST_TEST_EQ(check("01234567\xc3\xa9" "0123456789\x80"), 20u);
+}
+
+void carriage_return_tests()
+{
+    BOOST_TEST(!has_cr("No carriage returns in this text.\n"));
+    BOOST_TEST(has_cr("\r"));
+    BOOST_TEST(has_cr("Windows\r\nnewlines"));
+    BOOST_TEST(has_cr("0123456789abcdef\r"));
+    BOOST_TEST(has_cr("\xc3\xa9\r"));
+}
+
+int main()
+{
+    valid_tests();
+    invalid_tests();
+    carriage_return_tests();
+    return boost::report_errors();
+}